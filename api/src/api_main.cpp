@@ -1,6 +1,14 @@
 #include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <mutex>
 #include <thread>
+#include <stdexcept>
 #include <unordered_map>
+#include <unordered_set>
+#include <pthread.h>
+#include <sched.h>
 #include <boost/asio.hpp>
 #include <boost/beast.hpp>
 #include <boost/beast/websocket.hpp>
@@ -8,7 +16,8 @@
 #include <sqlite3.h>
 
 #include "../../engine/include/OrderBook.hpp"
-#include "../../engine/include/OrderBookManager.hpp"
+#include "../../engine/include/ShardedOrderBookManager.hpp"
+#include "../../engine/include/RingBuffer.hpp"
 
 using json = nlohmann::json;
 namespace beast = boost::beast;
@@ -20,11 +29,101 @@ using tcp = net::ip::tcp;
 void start_rest_server();
 json fetchTradesForReplay(const std::string& symbol, uint64_t ts_from, uint64_t ts_to);
 
-static OrderBookManager mgr;
-static uint64_t nextOrderId = 1000;
+// A connected WS client. Its session thread reads and answers REPLAY; the
+// publisher writes everything else to it, so writes take the client's own lock.
+struct Client {
+    std::shared_ptr<websocket::stream<tcp::socket>> ws;
+    std::mutex writeMutex;
+};
+
+// One client request on its way from a session thread to the sequencer.
+// Sessions parse and classify; the sequencer owns the symbol table and
+// order ids and is the only thread that talks to the shards.
+struct Command {
+    enum class Kind : uint8_t {
+        CONNECT,       // register `client` for broadcasts
+        DISCONNECT,    // cancel the owner's orders and drop `client`
+        NEW,
+        CANCEL,
+        MODIFY,
+        BATCH,
+        MASSCANCEL,
+        AUCTION,
+        UNCROSS
+    };
+
+    Kind kind;
+    uint32_t owner;
+    std::shared_ptr<Client> client;   // the sender; acks and rejects go back to it
+    json message;
+};
+
+// Requests waiting for the sequencer, in arrival order. One MPSC ring for
+// all sessions: that single order is what the sequencer stamps, and
+// per-session SPSC rings would need a registry it scans and merges.
+static constexpr size_t COMMAND_QUEUE_SIZE = 1024;
+static MpscRing<Command, COMMAND_QUEUE_SIZE> commands;
+
+// The matching shards, one pinned thread per group of symbols. Created by
+// main(); from then on only the sequencer touches it.
+static std::unique_ptr<ShardedOrderBookManager> shards;
+
+// One piece of outgoing work from the sequencer to the publisher thread.
+// The publisher owns the client list, the database writes and every
+// socket write except REPLAY answers, so neither sqlite nor a slow client
+// holds up matching. Events carry the symbol's name and tick size along,
+// since the symbol table belongs to the sequencer.
+struct Outbound {
+    enum class Kind : uint8_t {
+        CONNECT,      // add `client` to the broadcast list
+        DISCONNECT,   // drop `client`
+        TRADE,        // persist the fill in `event`, then broadcast it or
+                      // hold it for its auction
+        UNCROSSED,    // broadcast the fills held for auction `event.seq`
+        TOP,          // broadcast `event` as a top-of-book snapshot
+        REPLY         // send `message` to `client` alone
+    };
 
-// Keep list of connected WS clients (we broadcast all messages to every client; client filters by symbol)
-static std::vector<std::shared_ptr<websocket::stream<tcp::socket>>> clients;
+    Kind kind;
+    bool auction;                       // TRADE: fill of an uncross
+    ShardEvent event;                   // TRADE / UNCROSSED / TOP
+    double tickSize;                    // TRADE / TOP
+    char symbol[MAX_SYMBOL_NAME + 1];   // TRADE / UNCROSSED / TOP
+    std::shared_ptr<Client> client;     // CONNECT / DISCONNECT / REPLY
+    json message;                       // REPLY
+    uint64_t seq;                       // REPLY
+};
+
+static constexpr size_t OUTBOUND_QUEUE_SIZE = 4096;
+static SpscRing<Outbound, OUTBOUND_QUEUE_SIZE> outbound;
+
+// A command whose orders' statuses are still on their way back
+struct PendingAck {
+    std::shared_ptr<Client> client;
+    uint32_t statuses = 0;   // STATUS events still expected
+};
+
+// Sequencer thread only: the sequence number / timestamp / sender of the
+// command being applied, commands waiting for their statuses, uncrosses
+// waiting for their last fill, and the latest depth snapshot of each symbol
+// not published yet
+static uint64_t nextSeq = 1;
+static uint64_t currentSeq = 0;
+static uint64_t currentTs = 0;
+static std::shared_ptr<Client> currentClient;
+static std::unordered_map<uint64_t, PendingAck> acks;  // by command seq
+static std::unordered_set<uint64_t> auctions;          // command seqs
+static std::vector<ShardEvent> tops;                 // by SymbolId
+static std::vector<bool> topPending;                 // by SymbolId
+static std::vector<SymbolId> movedSymbols;
+
+// Publisher thread only: the clients to broadcast to, and the fills of
+// each running uncross
+static std::vector<std::shared_ptr<Client>> clients;
+static std::unordered_map<uint64_t, json> auctionTrades;  // by command seq
+
+// Every WS session is its own owner; 0 is reserved for "all owners"
+static std::atomic<uint32_t> nextOwnerId{1};
 
 // -------------------- SQLite helpers --------------------
 static bool ensure_db_schema() {
@@ -78,7 +177,7 @@ static bool ensure_db_schema() {
 }
 
 /* Save a trade row to DB */
-static void saveTradeToDB(const Trade &t, const std::string &symbol) {
+static void saveTradeToDB(const Trade &t, const std::string &symbol, double tickSize) {
     sqlite3* db = nullptr;
     if (sqlite3_open("trading.db", &db) != SQLITE_OK) {
         if (db) sqlite3_close(db);
@@ -93,7 +192,7 @@ static void saveTradeToDB(const Trade &t, const std::string &symbol) {
     if (sqlite3_prepare_v2(db, ins, -1, &stmt, nullptr) == SQLITE_OK) {
         sqlite3_bind_int64(stmt, 1, (sqlite3_int64)t.tradeId);
         sqlite3_bind_text(stmt, 2, symbol.c_str(), -1, SQLITE_TRANSIENT);
-        sqlite3_bind_double(stmt, 3, t.price);
+        sqlite3_bind_double(stmt, 3, fromTicks(t.price, tickSize));
         sqlite3_bind_int(stmt, 4, (int)t.quantity);
         sqlite3_bind_int64(stmt, 5, (sqlite3_int64)t.buyOrderId);
         sqlite3_bind_int64(stmt, 6, (sqlite3_int64)t.sellOrderId);
@@ -166,17 +265,21 @@ static void upsertCandle(const std::string &symbol, int tf_seconds, uint64_t sta
     sqlite3_close(db);
 }
 
-static void updateCandlesOnTrade(const Trade &t, const std::string &symbol) {
+static void updateCandlesOnTrade(const Trade &t, const std::string &symbol, double tickSize) {
     const int tfs[] = {1, 60};
     for (int tf : tfs) {
         uint64_t start = candle_start_for_tf(t.timestamp, tf);
-        upsertCandle(symbol, tf, start, t.price, t.quantity);
+        upsertCandle(symbol, tf, start, fromTicks(t.price, tickSize), t.quantity);
     }
 }
 
-// Broadcast to every WS client (clients should filter by symbol)
-void broadcast(const json& j) {
+// Publisher thread: broadcast to every WS client (clients should filter by
+// symbol), tagged with the sequence number of the command it answers (none
+// for a GTD expiry). A symbol's messages go out in seq order; different
+// symbols match on different shards and may interleave.
+void broadcast(const json& j, uint64_t seq) {
     json enriched = j;
+    if (seq) enriched["seq"] = seq;
     enriched["sendTs"] = (uint64_t) std::chrono::steady_clock::now()
                              .time_since_epoch()
                              .count();
@@ -184,11 +287,13 @@ void broadcast(const json& j) {
     std::string msg = enriched.dump();
 
     for (auto it = clients.begin(); it != clients.end();) {
-        auto& ws = *it;
+        Client& client = **it;
         beast::error_code ec;
-
-        ws->text(true);
-        ws->write(net::buffer(msg), ec);
+        {
+            std::lock_guard<std::mutex> lock(client.writeMutex);
+            client.ws->text(true);
+            client.ws->write(net::buffer(msg), ec);
+        }
 
         if (ec) {
             it = clients.erase(it);
@@ -198,12 +303,41 @@ void broadcast(const json& j) {
     }
 }
 
-json tradeToJSON(const Trade& t, const std::string& symbol, uint64_t orderTs) {
+// Send to one client only, tagged like a broadcast
+static void sendTo(Client& client, const json& j, uint64_t seq) {
+    json enriched = j;
+    enriched["seq"] = seq;
+    std::string msg = enriched.dump();
+
+    std::lock_guard<std::mutex> lock(client.writeMutex);
+    beast::error_code ec;
+    client.ws->text(true);
+    client.ws->write(net::buffer(msg), ec);
+}
+
+static const char* statusName(OrderStatus status) {
+    switch (status) {
+        case OrderStatus::ACCEPTED:          return "ACCEPTED";
+        case OrderStatus::DUPLICATE_ID:      return "DUPLICATE_ID";
+        case OrderStatus::POOL_EXHAUSTED:    return "POOL_EXHAUSTED";
+        case OrderStatus::LEVEL_UNAVAILABLE: return "LEVEL_UNAVAILABLE";
+        case OrderStatus::UNKNOWN_ORDER:     return "UNKNOWN_ORDER";
+        case OrderStatus::NOT_FILLABLE:      return "NOT_FILLABLE";
+        case OrderStatus::TIMER_EXHAUSTED:   return "TIMER_EXHAUSTED";
+        case OrderStatus::SELF_TRADE:        return "SELF_TRADE";
+        case OrderStatus::AUCTION_REJECTED:  return "AUCTION_REJECTED";
+        case OrderStatus::UNKNOWN_SYMBOL:    return "UNKNOWN_SYMBOL";
+        case OrderStatus::OFF_TICK:          return "OFF_TICK";
+    }
+    return "UNKNOWN";
+}
+
+json tradeToJSON(const Trade& t, const std::string& symbol, uint64_t orderTs, double tickSize) {
     return json{
         {"type", "trade"},
         {"symbol", symbol},
         {"tradeId", t.tradeId},
-        {"price", t.price},
+        {"price", fromTicks(t.price, tickSize)},
         {"quantity", t.quantity},
         {"buyOrderId", t.buyOrderId},
         {"sellOrderId", t.sellOrderId},
@@ -213,13 +347,8 @@ json tradeToJSON(const Trade& t, const std::string& symbol, uint64_t orderTs) {
     };
 }
 
-void broadcastTop(const std::string& symbol) {
-    auto* book = mgr.getOrderBook(symbol);
-    if (!book) return;
-
-    auto bids = book->getDepth(true, 10);
-    auto asks = book->getDepth(false, 10);
-
+// Depth snapshot from a shard, as a "top" message
+void broadcastTop(const ShardEvent& depth, const char* symbol, double tick) {
     json j;
     j["type"] = "top";
     j["symbol"] = symbol;
@@ -228,66 +357,449 @@ void broadcastTop(const std::string& symbol) {
     j["bids"] = json::array();
     j["asks"] = json::array();
 
-    for (auto& b : bids)
-        j["bids"].push_back({{"price", b.price}, {"qty", b.size}});
+    for (uint32_t i = 0; i < depth.bidCount; ++i) {
+        const DepthLevel& b = depth.bids[i];
+        j["bids"].push_back({{"price", fromTicks(b.price, tick)}, {"qty", b.size}, {"orders", b.orderCount}});
+    }
 
-    for (auto& a : asks)
-        j["asks"].push_back({{"price", a.price}, {"qty", a.size}});
+    for (uint32_t i = 0; i < depth.askCount; ++i) {
+        const DepthLevel& a = depth.asks[i];
+        j["asks"].push_back({{"price", fromTicks(a.price, tick)}, {"qty", a.size}, {"orders", a.orderCount}});
+    }
 
-    if (!bids.empty())
-        j["bestBid"] = bids.front().price;
+    if (depth.bidCount > 0)
+        j["bestBid"] = fromTicks(depth.bids[0].price, tick);
     else
         j["bestBid"] = nullptr;
 
-    if (!asks.empty())
-        j["bestAsk"] = asks.front().price;
+    if (depth.askCount > 0)
+        j["bestAsk"] = fromTicks(depth.asks[0].price, tick);
     else
         j["bestAsk"] = nullptr;
 
-    broadcast(j);
+    broadcast(j, depth.seq);
+}
+
+// One piece of work from the sequencer
+static void publish(Outbound& out) {
+    switch (out.kind) {
+        case Outbound::Kind::CONNECT:
+            clients.push_back(out.client);
+            break;
+        case Outbound::Kind::DISCONNECT:
+            clients.erase(std::remove(clients.begin(), clients.end(), out.client), clients.end());
+            break;
+        case Outbound::Kind::TRADE: {
+            const ShardEvent& e = out.event;
+            saveTradeToDB(e.trade, out.symbol, out.tickSize);
+            updateCandlesOnTrade(e.trade, out.symbol, out.tickSize);
+            json trade = tradeToJSON(e.trade, out.symbol, e.requestTs, out.tickSize);
+            if (out.auction) auctionTrades[e.seq].push_back(std::move(trade));
+            else broadcast(trade, e.seq);
+            break;
+        }
+        case Outbound::Kind::UNCROSSED: {
+            // An uncross that traded nothing still gets its (empty) message
+            auto held = auctionTrades.find(out.event.seq);
+            json trades = held != auctionTrades.end() ? std::move(held->second) : json::array();
+            if (held != auctionTrades.end()) auctionTrades.erase(held);
+            broadcast(json{{"type", "auctionTrades"}, {"symbol", out.symbol}, {"trades", std::move(trades)}},
+                      out.event.seq);
+            break;
+        }
+        case Outbound::Kind::TOP:
+            broadcastTop(out.event, out.symbol, out.tickSize);
+            break;
+        case Outbound::Kind::REPLY:
+            sendTo(*out.client, out.message, out.seq);
+            break;
+    }
+}
+
+// The publisher's loop: drain the sequencer's work in order
+static void publisher() {
+    Outbound out;
+    IdleBackoff backoff;
+    for (;;) {
+        if (!outbound.tryPop(out)) {
+            backoff.wait();
+            continue;
+        }
+        backoff.reset();
+        publish(out);
+        out.client.reset();
+    }
 }
 
-void handleNewOrder(const json& message) {
-    auto o = message["order"];
+// Sequencer thread: hand work to the publisher. It never waits for the sequencer, so a full
+// ring only means waiting for it to catch up.
+template <typename F>
+static void toPublisher(F&& fill) {
+    while (!outbound.tryPushWith(fill)) std::this_thread::yield();
+}
+
+// An event for the publisher, with its symbol's name and tick size
+static void withSymbol(Outbound& out, const ShardEvent& e) {
+    out.event = e;
+    out.tickSize = shards->tickSize(e.symbolId);
+    const std::string& name = shards->symbolName(e.symbolId);
+    std::memcpy(out.symbol, name.c_str(), name.size() + 1);
+}
+
+// A message for one client only
+static void replyTo(const std::shared_ptr<Client>& client, json message, uint64_t seq) {
+    toPublisher([&](Outbound& out) {
+        out.kind = Outbound::Kind::REPLY;
+        out.client = client;
+        out.message = std::move(message);
+        out.seq = seq;
+    });
+}
+
+// One event from a shard: fills go to the publisher to be persisted and
+// broadcast (an uncross's are held for its "auctionTrades" message); an
+// order's status goes back to its sender as an "ack"; depth snapshots wait
+// for the end of the poll, so a burst on one symbol costs one top broadcast
+static void onShardEvent(const ShardEvent& e) {
+    switch (e.kind) {
+        case ShardEvent::Kind::TRADE:
+            toPublisher([&](Outbound& out) {
+                out.kind = Outbound::Kind::TRADE;
+                out.auction = auctions.count(e.seq) > 0;
+                withSymbol(out, e);
+            });
+            break;
+        case ShardEvent::Kind::UNCROSSED:
+            if (auctions.erase(e.seq) == 0) break;
+            toPublisher([&](Outbound& out) {
+                out.kind = Outbound::Kind::UNCROSSED;
+                withSymbol(out, e);
+            });
+            break;
+        case ShardEvent::Kind::DEPTH:
+            if (e.symbolId >= tops.size()) {
+                tops.resize(e.symbolId + 1);
+                topPending.resize(e.symbolId + 1, false);
+            }
+            if (!topPending[e.symbolId]) movedSymbols.push_back(e.symbolId);
+            topPending[e.symbolId] = true;
+            tops[e.symbolId] = e;
+            break;
+        case ShardEvent::Kind::STATUS: {
+            auto ack = acks.find(e.seq);
+            if (ack == acks.end()) break;
+            replyTo(ack->second.client,
+                    json{{"type", "ack"}, {"orderId", e.orderId}, {"status", statusName(e.status)}}, e.seq);
+            if (--ack->second.statuses == 0) acks.erase(ack);
+            break;
+        }
+    }
+}
+
+// Take everything the shards have produced, then send the latest top of
+// each symbol that moved. Returns the number of events.
+static size_t pollShards() {
+    size_t n = shards->poll(onShardEvent);
+    for (SymbolId symbol : movedSymbols) {
+        toPublisher([&](Outbound& out) {
+            out.kind = Outbound::Kind::TOP;
+            withSymbol(out, tops[symbol]);
+        });
+        topPending[symbol] = false;
+    }
+    movedSymbols.clear();
+    return n;
+}
+
+// Hand a request to the shards. A full shard ring may be waiting on its
+// own full outbox, so drain events before trying again.
+template <typename F>
+static bool submit(F&& request) {
+    for (;;) {
+        SubmitStatus status = request();
+        if (status != SubmitStatus::QUEUE_FULL) return status == SubmitStatus::QUEUED;
+        pollShards();
+    }
+}
+
+// The command being applied has `count` more orders whose STATUS its sender awaits
+static void expectStatus(uint32_t count = 1) {
+    PendingAck& ack = acks[currentSeq];
+    ack.client = currentClient;
+    ack.statuses += count;
+}
+
+// The gateway id of `symbol`, registered with default book settings on
+// first use. Throws for a name longer than a shard request can carry.
+static SymbolId symbolOf(const std::string& symbol) {
+    SymbolId id = shards->findSymbol(symbol);
+    if (id != INVALID_SYMBOL) return id;
+    if (symbol.size() > MAX_SYMBOL_NAME) throw std::runtime_error("symbol name too long: " + symbol);
+    while ((id = shards->addSymbol(symbol)) == INVALID_SYMBOL) pollShards();
+    return id;
+}
+
+// Build an engine order from a client "order" object; assigns the orderId
+static Order orderFromJSON(const json& o, uint32_t owner) {
     Order ord;
-    ord.orderId = nextOrderId++;
-    ord.symbol = o["symbol"];
+    ord.ownerId = owner;
+    std::string symbol = o["symbol"];
+    ord.symbolId = symbolOf(symbol);
+    ord.orderId = shards->newOrderId(ord.symbolId);
     ord.side = (o["side"] == "BUY" ? Side::BUY : Side::SELL);
-    ord.type = (o["type"] == "LIMIT" ? OrderType::LIMIT : OrderType::MARKET);
-    ord.price = o["price"];
+    std::string type = o["type"];
+    ord.type = type == "LIMIT"      ? OrderType::LIMIT
+             : type == "STOP"       ? OrderType::STOP
+             : type == "STOP_LIMIT" ? OrderType::STOP_LIMIT
+             : OrderType::MARKET;
+    double tick = shards->tickSize(ord.symbolId);
+    double price = o["price"].get<double>();
+    double stopPrice = o.value("stopPrice", 0.0);
+    // A limit is never rounded to a price the client did not ask for
+    if (!isOnTick(price, tick) || !isOnTick(stopPrice, tick))
+        throw std::runtime_error("price not a multiple of tick size " + std::to_string(tick));
+    ord.price = toTicks(price, tick);
+    ord.stopPrice = toTicks(stopPrice, tick);
     ord.quantity = o["quantity"];
-    ord.timestamp = (uint64_t) std::chrono::steady_clock::now().time_since_epoch().count();
+    std::string tif = o.value("tif", "GTC");
+    ord.timeInForce = tif == "IOC" ? TimeInForce::IOC
+                    : tif == "FOK" ? TimeInForce::FOK
+                    : tif == "GTD" ? TimeInForce::GTD
+                    : TimeInForce::GTC;
+    ord.displayQty = o.value("displayQty", (uint32_t)0);
+    std::string stp = o.value("stp", "NONE");
+    ord.stp = stp == "NEWEST"    ? SelfTradePrevention::CANCEL_NEWEST
+            : stp == "OLDEST"    ? SelfTradePrevention::CANCEL_OLDEST
+            : stp == "BOTH"      ? SelfTradePrevention::CANCEL_BOTH
+            : stp == "DECREMENT" ? SelfTradePrevention::DECREMENT
+            : SelfTradePrevention::NONE;
+    ord.timestamp = currentTs;
+    if (ord.timeInForce == TimeInForce::GTD)
+        ord.expireTime = ord.timestamp + o.value("expireMs", (uint64_t)0) * 1000000ULL;
+    return ord;
+}
+
+// Fills, statuses and tops of every handler come back through
+// onShardEvent; GTD expiry runs on the shards themselves
+
+void handleNewOrder(const json& message, uint32_t owner) {
+    Order ord = orderFromJSON(message["order"], owner);
+    if (submit([&] { return shards->submit(ord); })) expectStatus();
+}
+
+// {"cmd":"BATCH","orders":[{...}, ...]}: every order is parsed before any
+// is sent, then each shard applies its part as one batch, with one depth
+// snapshot per symbol
+void handleBatch(const json& message, uint32_t owner) {
+    std::vector<Order> batch;
+    for (const auto& o : message.value("orders", json::array())) batch.push_back(orderFromJSON(o, owner));
+
+    for (size_t sent = 0; sent < batch.size();) {
+        size_t queued = 0;
+        SubmitStatus status = shards->submit(std::span<const Order>(batch).subspan(sent), queued);
+        sent += queued;
+        if (status == SubmitStatus::UNKNOWN_SYMBOL) return;
+        if (status == SubmitStatus::QUEUE_FULL) pollShards();
+    }
+    expectStatus(uint32_t(batch.size()));
+}
+
+// {"cmd":"AUCTION","symbol":"AAPL"} starts a call auction;
+// {"cmd":"UNCROSS","symbol":"AAPL"} ends it. The uncross goes out as one
+// "auctionTrades" message and one top/depth broadcast.
+void handleAuction(const json& message, bool start) {
+    std::string symbol = message.value("symbol", "");
+    if (symbol.empty()) {
+        std::cerr << "[WARN] " << (start ? "AUCTION" : "UNCROSS") << " missing symbol\n";
+        return;
+    }
+    // An opening auction may start before the symbol's first order
+    if (start) {
+        SymbolId symbolId = symbolOf(symbol);
+        submit([&] { return shards->startAuction(symbolId); });
+        return;
+    }
+    SymbolId symbolId = shards->findSymbol(symbol);
+    if (symbolId == INVALID_SYMBOL) {
+        std::cerr << "[WARN] UNCROSS unknown symbol " << symbol << "\n";
+        return;
+    }
 
-    // Add to the manager (per-symbol book)
-    auto trades = mgr.addOrder(ord.symbol, ord);
+    // Fills tagged with this command's seq are held until UNCROSSED
+    auctions.insert(currentSeq);
+    submit([&] { return shards->uncross(symbolId); });
+}
 
-    // Persist & broadcast each trade
-    for (auto &t : trades) {
-        saveTradeToDB(t, ord.symbol);
-        updateCandlesOnTrade(t, ord.symbol);
-        broadcast(tradeToJSON(t, ord.symbol, ord.timestamp));
+// {"cmd":"MASSCANCEL"[,"symbol":"AAPL"][,"side":"BUY"]}: cancel this
+// session's orders, on every symbol unless one is given
+void handleMassCancel(const json& message, uint32_t owner) {
+    SymbolId symbolId = INVALID_SYMBOL;
+    std::string symbol = message.value("symbol", "");
+    if (!symbol.empty()) {
+        symbolId = shards->findSymbol(symbol);
+        if (symbolId == INVALID_SYMBOL) {
+            std::cerr << "[WARN] MASSCANCEL unknown symbol " << symbol << "\n";
+            return;
+        }
     }
 
-    // broadcast top-of-book for that symbol
-    broadcastTop(ord.symbol);
+    std::string side = message.value("side", "");
+    SideFilter sides = side == "BUY"  ? SideFilter::BUY
+                     : side == "SELL" ? SideFilter::SELL
+                     : SideFilter::BOTH;
+
+    // On every shard, a retry after a partial QUEUE_FULL cancels nothing twice
+    submit([&] { return shards->massCancel(symbolId, owner, sides); });
 }
 
 void handleCancel(const json& message) {
     std::string symbol = message.value("symbol", "");
     uint64_t id = message.value("orderId", (uint64_t)0);
 
+    // Without a symbol the order id names its shard, which finds the book
     if (symbol.empty()) {
-        std::cerr << "[WARN] CANCEL missing symbol\n";
+        submit([&] { return shards->cancel(id); });
         return;
     }
 
-    mgr.cancelOrder(symbol, id);
+    SymbolId symbolId = shards->findSymbol(symbol);
+    if (symbolId == INVALID_SYMBOL) {
+        std::cerr << "[WARN] CANCEL unknown symbol " << symbol << "\n";
+        return;
+    }
+
+    submit([&] { return shards->cancel(symbolId, id); });
+}
+
+void handleModify(const json& message) {
+    std::string symbol = message.value("symbol", "");
+    uint64_t id = message.value("orderId", (uint64_t)0);
+    double price = message.value("price", 0.0);
+    uint32_t qty = message.value("quantity", (uint32_t)0);
+
+    // As for CANCEL; the shard converts the price with the order's own tick
+    if (symbol.empty()) {
+        if (submit([&] { return shards->modify(id, price, qty); })) expectStatus();
+        return;
+    }
+
+    SymbolId symbolId = shards->findSymbol(symbol);
+    if (symbolId == INVALID_SYMBOL) {
+        std::cerr << "[WARN] MODIFY unknown symbol " << symbol << "\n";
+        return;
+    }
+
+    double tick = shards->tickSize(symbolId);
+    if (!isOnTick(price, tick))
+        throw std::runtime_error("price not a multiple of tick size " + std::to_string(tick));
+    Price ticks = toTicks(price, tick);
+    if (submit([&] { return shards->modify(symbolId, id, ticks, qty); })) expectStatus();
+}
+
+static void pinToCpu(int cpu) {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+        std::cerr << "[WARN] sequencer: could not pin to cpu " << cpu << "\n";
+#else
+    (void)cpu;
+#endif
+}
+
+static void dispatch(const Command& command) {
+    const json& j = command.message;
+    switch (command.kind) {
+        case Command::Kind::CONNECT:
+        case Command::Kind::DISCONNECT:
+            toPublisher([&](Outbound& out) {
+                out.kind = command.kind == Command::Kind::CONNECT ? Outbound::Kind::CONNECT
+                                                                  : Outbound::Kind::DISCONNECT;
+                out.client = command.client;
+            });
+            // Cancel-on-disconnect: nothing of a gone client stays in the books
+            if (command.kind == Command::Kind::DISCONNECT) handleMassCancel(json::object(), command.owner);
+            break;
+        case Command::Kind::NEW:        handleNewOrder(j, command.owner); break;
+        case Command::Kind::CANCEL:     handleCancel(j); break;
+        case Command::Kind::MODIFY:     handleModify(j); break;
+        case Command::Kind::BATCH:      handleBatch(j, command.owner); break;
+        case Command::Kind::MASSCANCEL: handleMassCancel(j, command.owner); break;
+        case Command::Kind::AUCTION:    handleAuction(j, true); break;
+        case Command::Kind::UNCROSS:    handleAuction(j, false); break;
+    }
+}
+
+// Stamp one command with its sequence number and timestamp and hand it to
+// the shards; the events it causes carry the same stamp. Runs on the
+// sequencer only.
+static void apply(const Command& command) {
+    currentSeq = nextSeq++;
+    currentTs = (uint64_t) std::chrono::steady_clock::now().time_since_epoch().count();
+    currentClient = command.client;
+    shards->setStamp(currentSeq, currentTs);
+
+    // A malformed message costs its sender the command, not the engine its thread
+    try {
+        dispatch(command);
+    } catch (const std::exception& e) {
+        std::cerr << "[WARN] command " << currentSeq << " failed: " << e.what() << "\n";
+        if (currentClient) replyTo(currentClient, json{{"type", "reject"}, {"reason", e.what()}}, currentSeq);
+    }
+    currentClient.reset();
+}
+
+// The gateway in front of the shards: takes commands in the order they
+// entered the queue and routes them one at a time, so each symbol's shard
+// sees that order and every order id and seq is handed out without a lock.
+// Between commands it drains the shards' events and hands them to the
+// publisher.
+static void sequencer(int cpu) {
+    if (cpu >= 0) pinToCpu(cpu);
+
+    Command command;
+    IdleBackoff backoff;
+    for (;;) {
+        bool busy = false;
+        if (commands.tryPop(command)) {
+            apply(command);
+            command.client.reset();
+            busy = true;
+        }
+        if (pollShards() > 0) busy = true;
+        if (busy) backoff.reset();
+        else backoff.wait();
+    }
+}
+
+// Connect / disconnect must reach the sequencer, whatever the load
+static void enqueueControl(Command::Kind kind, uint32_t owner, const std::shared_ptr<Client>& client) {
+    while (!commands.tryPushWith([&](Command& c) {
+        c.kind = kind;
+        c.owner = owner;
+        c.client = client;
+        c.message = json();
+    })) {
+        std::this_thread::yield();
+    }
 }
 
 void session(std::shared_ptr<websocket::stream<tcp::socket>> ws) {
     ws->accept();
     std::cout << "[API] Client connected\n";
-    clients.push_back(ws);
+    auto client = std::make_shared<Client>();
+    client->ws = ws;
+    const uint32_t owner = nextOwnerId++;
+    enqueueControl(Command::Kind::CONNECT, owner, client);
+
+    // Answer this client alone, clear of the publisher's broadcasts
+    auto reply = [&](const std::string& text) {
+        std::lock_guard<std::mutex> lock(client->writeMutex);
+        beast::error_code ec;
+        ws->text(true);
+        ws->write(net::buffer(text), ec);
+    };
 
     beast::flat_buffer buffer;
     while (true) {
@@ -302,25 +814,43 @@ void session(std::shared_ptr<websocket::stream<tcp::socket>> ws) {
         if (j.is_discarded()) continue;
 
         std::string cmd = j.value("cmd", std::string());
-        if (cmd == "NEW") {
-            handleNewOrder(j);
-        } else if (cmd == "CANCEL") {
-            handleCancel(j);
-        } else if (cmd == "REPLAY") {
-            std::string symbol = j["symbol"];
-            uint64_t from = j["from"];
-            uint64_t to = j["to"];
-
-            json result = {
-                {"type", "replayData"},
-                {"symbol", symbol},
-                {"trades", fetchTradesForReplay(symbol, from, to)}
-            };
-
-            ws->text(true);
-            ws->write(net::buffer(result.dump()));
+        Command::Kind kind;
+        if (cmd == "NEW") kind = Command::Kind::NEW;
+        else if (cmd == "CANCEL") kind = Command::Kind::CANCEL;
+        else if (cmd == "MODIFY") kind = Command::Kind::MODIFY;
+        else if (cmd == "BATCH") kind = Command::Kind::BATCH;
+        else if (cmd == "MASSCANCEL") kind = Command::Kind::MASSCANCEL;
+        else if (cmd == "AUCTION") kind = Command::Kind::AUCTION;
+        else if (cmd == "UNCROSS") kind = Command::Kind::UNCROSS;
+        else {
+            if (cmd == "REPLAY") {
+                std::string symbol = j["symbol"];
+                uint64_t from = j["from"];
+                uint64_t to = j["to"];
+
+                json result = {
+                    {"type", "replayData"},
+                    {"symbol", symbol},
+                    {"trades", fetchTradesForReplay(symbol, from, to)}
+                };
+                reply(result.dump());
+            }
+            continue;
+        }
+
+        bool queued = commands.tryPushWith([&](Command& c) {
+            c.kind = kind;
+            c.owner = owner;
+            c.client = client;
+            c.message = std::move(j);
+        });
+        if (!queued) {
+            std::cerr << "[WARN] sequencer queue full, rejecting " << cmd << "\n";
+            reply("{\"type\":\"reject\",\"reason\":\"engine busy\"}");
         }
     }
+
+    enqueueControl(Command::Kind::DISCONNECT, owner, client);
 }
 
 json fetchTradesForReplay(const std::string& symbol, uint64_t ts_from, uint64_t ts_to) {
@@ -373,6 +903,15 @@ int main() {
         std::thread restThread(start_rest_server);
         restThread.detach();
 
+        // Shard k matches on CPU k and the sequencer runs on the last CPU.
+        // Session threads and the publisher are not pinned; the scheduler
+        // places them.
+        unsigned cpus = std::max(1u, std::thread::hardware_concurrency());
+        // Shards publish a depth snapshot after every request that moves a book
+        shards = std::make_unique<ShardedOrderBookManager>(cpus > 1 ? cpus - 1 : 1, std::vector<int>{}, true);
+        std::thread(publisher).detach();
+        std::thread(sequencer, cpus > 1 ? int(cpus - 1) : -1).detach();
+
         net::io_context ioc;
         tcp::acceptor acceptor(ioc, {tcp::v4(), 9001});
 
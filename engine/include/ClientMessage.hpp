@@ -0,0 +1,48 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+#include "Order.hpp"
+
+// Longest symbol name / command line a ClientMessage carries
+constexpr size_t CLIENT_SYMBOL_MAX = 31;
+constexpr size_t CLIENT_TEXT_MAX = 255;
+
+// One engine command line (CLI or market-data WS client), decoded into a
+// fixed-size record so network threads can hand it to the matching loop
+// through a ring without allocating. Order entry is decoded field by
+// field; everything else (configuration, SNAP, QUIT, ...) is rare and kept
+// as its cleaned-up text. Prices stay decimal: converting them to ticks
+// needs the symbol's book, which belongs to the matching loop.
+struct ClientMessage {
+    enum class Kind : uint8_t {
+        NEW,
+        CANCEL,
+        MODIFY,
+        TEXT
+    };
+
+    Kind kind;
+    char symbol[CLIENT_SYMBOL_MAX + 1];   // empty: CANCEL / MODIFY by orderId alone
+    uint64_t orderId;
+
+    // NEW
+    Side side;
+    OrderType type;
+    double price;                         // NEW / MODIFY; 0 for MARKET / STOP
+    uint32_t quantity;                    // NEW / MODIFY
+    TimeInForce timeInForce;
+    uint64_t lifetimeMs;                  // GTD
+    uint32_t displayQty;
+    double stopPrice;
+    uint32_t ownerId;
+    SelfTradePrevention stp;
+
+    char text[CLIENT_TEXT_MAX + 1];       // TEXT, comment stripped and trimmed
+};
+
+// Decode one command line. Returns false for blank and comment-only lines,
+// and for malformed NEW / CANCEL / MODIFY lines, whose problem is reported
+// on stderr.
+bool decodeClientMessage(const std::string& line, ClientMessage& out);
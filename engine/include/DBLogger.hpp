@@ -12,8 +12,9 @@ public:
 
     bool init(const std::string& path);
 
-    void logOrder(const Order& o);
-    void logTrade(const Trade& t, const std::string& symbol);
+    // Prices are stored as decimals, converted from ticks with `tickSize`
+    void logOrder(const Order& o, const std::string& symbol, double tickSize);
+    void logTrade(const Trade& t, const std::string& symbol, double tickSize);
 
 private:
     sqlite3* db;
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cinttypes>
+
+// Structured, asynchronous diagnostics for the engine.
+//
+// Call sites use the ENGINE_LOG_* macros with printf-style formats. Messages
+// at or above ENGINE_LOG_LEVEL are formatted into a fixed-size record on a
+// lock-free ring and written to stderr by a background thread, so the
+// matching path never blocks on I/O. Messages below the level compile to
+// nothing. The default is WARN in every build type, since stderr also
+// carries the market-data lines; override with -DENGINE_LOG_LEVEL=<n>.
+
+#define ENGINE_LOG_LEVEL_DEBUG 0
+#define ENGINE_LOG_LEVEL_INFO  1
+#define ENGINE_LOG_LEVEL_WARN  2
+#define ENGINE_LOG_LEVEL_ERROR 3
+#define ENGINE_LOG_LEVEL_OFF   4
+
+#ifndef ENGINE_LOG_LEVEL
+#  define ENGINE_LOG_LEVEL ENGINE_LOG_LEVEL_WARN
+#endif
+
+namespace Log {
+
+enum class Level {
+    DEBUG = ENGINE_LOG_LEVEL_DEBUG,
+    INFO  = ENGINE_LOG_LEVEL_INFO,
+    WARN  = ENGINE_LOG_LEVEL_WARN,
+    ERROR = ENGINE_LOG_LEVEL_ERROR
+};
+
+// Enqueue one message; never blocks. If the ring is full the message is
+// dropped and counted. Starts the drain thread on first use.
+void write(Level level, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+
+// Drain everything queued so far and stop the background thread
+void stop();
+
+} // namespace Log
+
+#if ENGINE_LOG_LEVEL <= ENGINE_LOG_LEVEL_DEBUG
+#  define ENGINE_LOG_DEBUG(...) ::Log::write(::Log::Level::DEBUG, __VA_ARGS__)
+#else
+#  define ENGINE_LOG_DEBUG(...) ((void)0)
+#endif
+
+#if ENGINE_LOG_LEVEL <= ENGINE_LOG_LEVEL_INFO
+#  define ENGINE_LOG_INFO(...) ::Log::write(::Log::Level::INFO, __VA_ARGS__)
+#else
+#  define ENGINE_LOG_INFO(...) ((void)0)
+#endif
+
+#if ENGINE_LOG_LEVEL <= ENGINE_LOG_LEVEL_WARN
+#  define ENGINE_LOG_WARN(...) ::Log::write(::Log::Level::WARN, __VA_ARGS__)
+#else
+#  define ENGINE_LOG_WARN(...) ((void)0)
+#endif
+
+#if ENGINE_LOG_LEVEL <= ENGINE_LOG_LEVEL_ERROR
+#  define ENGINE_LOG_ERROR(...) ::Log::write(::Log::Level::ERROR, __VA_ARGS__)
+#else
+#  define ENGINE_LOG_ERROR(...) ((void)0)
+#endif
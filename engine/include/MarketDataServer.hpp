@@ -1,5 +1,6 @@
 #pragma once
 #include <string>
+#include "ClientMessage.hpp"
 
 namespace MarketDataServerAPI {
 // Start server on port (non-blocking)
@@ -8,9 +9,10 @@ void start(unsigned short port);
 // Broadcast JSON/text line to all connected WS clients (thread-safe)
 void broadcast(const std::string& msg);
 
-// Try to pop one client-sent message (non-blocking).
-// Returns true and sets out if a message was available.
-bool try_pop_client_message(std::string &out);
+// Try to pop one client-sent message, already decoded by its session's
+// network thread (non-blocking). Returns true and sets out if a message was
+// available. Call from the matching loop only.
+bool try_pop_client_message(ClientMessage &out);
 
 // Stop server (join thread)
 void stop();
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <new>
+#include <algorithm>
+#include <memory>
+#include <cstddef>
+#include <utility>
+
+// Fixed-capacity pool of equally sized blocks carved out of one slab that is
+// allocated up front. Free blocks form an intrusive singly linked list, so
+// allocate/deallocate are a couple of pointer moves and never touch the heap.
+// allocate() returns nullptr once the pool is exhausted.
+class SlabPool {
+public:
+    SlabPool(size_t blockSize, size_t capacity)
+        : blockSize_(roundUp(std::max(blockSize, sizeof(FreeBlock)))),
+          capacity_(capacity),
+          slab(new std::byte[blockSize_ * capacity]) {
+        for (size_t i = capacity; i-- > 0;) {
+            auto* block = reinterpret_cast<FreeBlock*>(slab.get() + i * blockSize_);
+            block->next = freeList;
+            freeList = block;
+        }
+        available_ = capacity;
+    }
+
+    SlabPool(const SlabPool&) = delete;
+    SlabPool& operator=(const SlabPool&) = delete;
+
+    void* allocate() {
+        if (!freeList) return nullptr;
+        FreeBlock* block = freeList;
+        freeList = block->next;
+        --available_;
+        return block;
+    }
+
+    void deallocate(void* p) {
+        auto* block = static_cast<FreeBlock*>(p);
+        block->next = freeList;
+        freeList = block;
+        ++available_;
+    }
+
+    bool owns(const void* p) const {
+        auto* b = static_cast<const std::byte*>(p);
+        return b >= slab.get() && b < slab.get() + blockSize_ * capacity_;
+    }
+
+    size_t blockSize() const { return blockSize_; }
+    size_t capacity() const { return capacity_; }
+    size_t available() const { return available_; }
+
+private:
+    struct FreeBlock { FreeBlock* next; };
+
+    static size_t roundUp(size_t n) {
+        constexpr size_t align = alignof(std::max_align_t);
+        return (n + align - 1) / align * align;
+    }
+
+    size_t blockSize_;
+    size_t capacity_;
+    size_t available_ = 0;
+    std::unique_ptr<std::byte[]> slab;
+    FreeBlock* freeList = nullptr;
+};
+
+// Typed front-end over a SlabPool
+template <typename T>
+class ObjectPool {
+public:
+    explicit ObjectPool(size_t capacity) : pool(sizeof(T), capacity) {}
+
+    // nullptr if the pool is exhausted
+    template <typename... Args>
+    T* create(Args&&... args) {
+        void* p = pool.allocate();
+        if (!p) return nullptr;
+        return new (p) T{std::forward<Args>(args)...};
+    }
+
+    void destroy(T* obj) {
+        obj->~T();
+        pool.deallocate(obj);
+    }
+
+    size_t capacity() const { return pool.capacity(); }
+    size_t available() const { return pool.available(); }
+
+private:
+    SlabPool pool;
+};
+
+// STL allocator drawing single nodes from a SlabPool, for node-based
+// containers (std::map). Requests that do not fit a block fall back to the
+// heap, so a wrong block-size estimate costs speed, never correctness.
+template <typename T>
+class PoolAllocator {
+public:
+    using value_type = T;
+
+    explicit PoolAllocator(SlabPool* pool) : pool(pool) {}
+
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U>& other) : pool(other.pool) {}
+
+    T* allocate(size_t n) {
+        if (n == 1 && sizeof(T) <= pool->blockSize()) {
+            if (void* p = pool->allocate()) return static_cast<T*>(p);
+        }
+        return static_cast<T*>(::operator new(n * sizeof(T)));
+    }
+
+    void deallocate(T* p, size_t) {
+        if (pool->owns(p)) pool->deallocate(p);
+        else ::operator delete(p);
+    }
+
+    template <typename U>
+    bool operator==(const PoolAllocator<U>& other) const { return pool == other.pool; }
+    template <typename U>
+    bool operator!=(const PoolAllocator<U>& other) const { return pool != other.pool; }
+
+private:
+    template <typename U> friend class PoolAllocator;
+    SlabPool* pool;
+};
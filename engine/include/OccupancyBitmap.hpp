@@ -0,0 +1,121 @@
+#pragma once
+
+#include <bit>
+#include <array>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Three-level bitset over [0, n). Bit i of level 0 marks index i as set; bit
+// j of level k marks word j of level k-1 as non-zero. Finding the next or
+// previous set index touches at most one word per level on the way up and
+// one on the way down, each resolved with a single ctz/clz, so the search
+// cost does not depend on how many clear indices it skips. With 64-bit words
+// three levels cover 2^18 indices before the top level needs a second word;
+// the top level is scanned linearly, which stays a handful of words for any
+// ladder size we allow.
+class OccupancyBitmap {
+public:
+    static constexpr size_t npos = SIZE_MAX;
+
+    explicit OccupancyBitmap(size_t n = 0) { reset(n); }
+
+    // Resize to `n` indices, all clear
+    void reset(size_t n) {
+        bits = n;
+        size_t count = n;
+        for (auto& words : levels) {
+            count = (count + 63) / 64;
+            words.assign(count ? count : 1, 0);
+        }
+    }
+
+    size_t size() const { return bits; }
+
+    bool test(size_t i) const { return levels[0][i >> 6] >> (i & 63) & 1; }
+
+    void set(size_t i) {
+        for (auto& words : levels) {
+            uint64_t& w = words[i >> 6];
+            bool wasEmpty = w == 0;
+            w |= uint64_t(1) << (i & 63);
+            if (!wasEmpty) return;
+            i >>= 6;
+        }
+    }
+
+    void clear(size_t i) {
+        for (auto& words : levels) {
+            uint64_t& w = words[i >> 6];
+            w &= ~(uint64_t(1) << (i & 63));
+            if (w != 0) return;
+            i >>= 6;
+        }
+    }
+
+    // Smallest set index >= i, or npos
+    size_t next(size_t i) const {
+        if (i >= bits) return npos;
+        size_t lvl = 0;
+        for (;;) {
+            const auto& words = levels[lvl];
+            size_t w = i >> 6;
+            uint64_t masked = words[w] & (~uint64_t(0) << (i & 63));
+            if (masked) {
+                i = (w << 6) | size_t(std::countr_zero(masked));
+                break;
+            }
+            if (lvl == TOP) {
+                while (++w < words.size() && words[w] == 0) {}
+                if (w == words.size()) return npos;
+                i = (w << 6) | size_t(std::countr_zero(words[w]));
+                break;
+            }
+            i = w + 1;
+            if (i >= words.size()) return npos;
+            ++lvl;
+        }
+        while (lvl > 0) {
+            --lvl;
+            i = (i << 6) | size_t(std::countr_zero(levels[lvl][i]));
+        }
+        return i;
+    }
+
+    // Largest set index <= i, or npos
+    size_t prev(size_t i) const {
+        if (bits == 0) return npos;
+        if (i >= bits) i = bits - 1;
+        size_t lvl = 0;
+        for (;;) {
+            const auto& words = levels[lvl];
+            size_t w = i >> 6;
+            unsigned b = unsigned(i & 63);
+            uint64_t masked = words[w] & (b == 63 ? ~uint64_t(0) : (uint64_t(2) << b) - 1);
+            if (masked) {
+                i = (w << 6) | size_t(63 - std::countl_zero(masked));
+                break;
+            }
+            if (w == 0) return npos;
+            if (lvl == TOP) {
+                while (w-- > 0 && words[w] == 0) {}
+                if (w == npos) return npos;
+                i = (w << 6) | size_t(63 - std::countl_zero(words[w]));
+                break;
+            }
+            i = w - 1;
+            ++lvl;
+        }
+        while (lvl > 0) {
+            --lvl;
+            i = (i << 6) | size_t(63 - std::countl_zero(levels[lvl][i]));
+        }
+        return i;
+    }
+
+private:
+    static constexpr size_t TOP = 2;
+
+    size_t bits = 0;
+    std::array<std::vector<uint64_t>, TOP + 1> levels;
+};
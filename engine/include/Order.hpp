@@ -1,7 +1,39 @@
 #pragma once
 
+#include <cmath>
 #include <cstdint>
-#include <string>
+
+// Fixed-point price: an integer number of ticks. Decimal prices only exist at
+// the edges (CLI / JSON / DB); the book itself compares and hashes integers.
+using Price = int64_t;
+
+// Dense per-engine symbol id, assigned by SymbolRegistry at the gateway
+using SymbolId = uint32_t;
+constexpr SymbolId INVALID_SYMBOL = UINT32_MAX;
+
+// Tick size used for symbols that have not been configured explicitly
+constexpr double DEFAULT_TICK_SIZE = 0.01;
+
+// Tolerance, in ticks, for decimal noise in a price that is meant to be on
+// the grid (100.07 / 0.01 is 10006.999999999998)
+constexpr double TICK_EPSILON = 1e-6;
+
+// Gateways check client prices with this before toTicks: an off-grid limit
+// is rejected rather than rounded to a tick the client did not ask for
+inline bool isOnTick(double price, double tickSize) {
+    double ticks = price / tickSize;
+    return std::fabs(ticks - std::nearbyint(ticks)) <= TICK_EPSILON;
+}
+
+inline Price toTicks(double price, double tickSize) {
+    return static_cast<Price>(std::llround(price / tickSize));
+}
+
+// Divides by the reciprocal tick, which is exact for ticks like 0.1 and
+// 0.01: 1001 * 0.1 prints as 100.10000000000001, 1001 / 10 as 100.1
+inline double fromTicks(Price ticks, double tickSize) {
+    return static_cast<double>(ticks) / (1.0 / tickSize);
+}
 
 enum class Side {
     BUY,
@@ -10,20 +42,60 @@ enum class Side {
 
 enum class OrderType {
     LIMIT,
-    MARKET
+    MARKET,
+    STOP,        // becomes MARKET when the last trade reaches stopPrice
+    STOP_LIMIT   // becomes LIMIT at `price` when the last trade reaches stopPrice
+};
+
+// How long an unfilled LIMIT remainder stays live
+enum class TimeInForce {
+    GTC,    // good till cancelled: the remainder rests
+    IOC,    // immediate or cancel: match what crosses, drop the rest
+    FOK,    // fill or kill: fill completely right now, or do nothing
+    GTD     // good till date: the remainder rests until expireTime
 };
 
+// What happens when an order would trade against a resting order of the
+// same owner. The incoming order's mode decides.
+enum class SelfTradePrevention {
+    NONE,           // trade normally
+    CANCEL_NEWEST,  // cancel the incoming order's remainder
+    CANCEL_OLDEST,  // cancel the resting order and keep matching
+    CANCEL_BOTH,    // cancel both
+    DECREMENT       // take the smaller quantity off both, without a trade
+};
+
+// Owner id that matches no order; self-trade checks compare against it when off
+constexpr uint32_t NO_SELF_MATCH = UINT32_MAX;
+
 struct Order {
     uint64_t orderId;
-    std::string symbol;
+    SymbolId symbolId;
 
-    Side side;  
+    Side side;
     OrderType type;
 
-    // For LIMIT orders; ignored for MARKET orders
-    double price;
+    // For LIMIT / STOP_LIMIT orders, in ticks; ignored for MARKET / STOP
+    Price price;
     uint32_t quantity;
 
     // Nanoseconds since start or system clock
     uint64_t timestamp;
+
+    TimeInForce timeInForce = TimeInForce::GTC;
+
+    // Iceberg peak: while resting, at most this much is displayed and the
+    // rest is held in reserve. 0 displays the full quantity.
+    uint32_t displayQty = 0;
+
+    // STOP / STOP_LIMIT trigger, in ticks
+    Price stopPrice = 0;
+
+    // Session / account that owns the order, for mass cancel and
+    // self-trade prevention; 0 = none
+    uint32_t ownerId = 0;
+    SelfTradePrevention stp = SelfTradePrevention::NONE;
+
+    // GTD expiry, on the same clock as timestamp
+    uint64_t expireTime = 0;
 };
@@ -1,63 +1,356 @@
 #pragma once
 
-#include <map>
-#include <deque>
 #include <vector>
 #include <cstdint>
+#include <memory>
+#include <optional>
+#include <type_traits>
 #include "Order.hpp"
+#include "ObjectPool.hpp"
+#include "OrderIdMap.hpp"
+#include "PriceLevels.hpp"
+#include "PriceLadder.hpp"
+#include "StopBook.hpp"
 
 struct Trade {
     uint64_t tradeId;
     uint64_t buyOrderId;
     uint64_t sellOrderId;
-    double price;
+    Price price;
     uint32_t quantity;
     uint64_t timestamp;
+    SymbolId symbolId;
+};
+
+// Non-owning reference to a callable that receives fills as they happen.
+// Two words, no allocation; the callable must outlive the call it is passed to.
+class TradeSink {
+public:
+    template <typename F>
+        requires (!std::is_same_v<std::remove_cvref_t<F>, TradeSink> &&
+                  std::is_invocable_v<F&, const Trade&>)
+    TradeSink(F&& f)
+        : target(const_cast<void*>(static_cast<const void*>(std::addressof(f)))),
+          call([](void* p, const Trade& t) { (*static_cast<std::remove_reference_t<F>*>(p))(t); }) {}
+
+    void operator()(const Trade& t) const { call(target, t); }
+
+private:
+    void* target;
+    void (*call)(void*, const Trade&);
 };
 
 struct DepthLevel {
-    double price;
-    uint32_t size;
+    Price price;
+    uint64_t size;        // total resting quantity
+    uint32_t orderCount;
 };
 
-// Comparator: highest price first (for bids)
-struct DescendingPrice {
-    bool operator()(double a, double b) const {
-        return a > b;       // higher prices come first
-    }
+// Outcome of the most recent BasicOrderBook::addOrder / modifyOrder
+enum class OrderStatus {
+    ACCEPTED,           // matched and/or rested normally
+    DUPLICATE_ID,       // rejected: an order with this id is already resting
+    POOL_EXHAUSTED,     // remainder dropped: no free order node
+    LEVEL_UNAVAILABLE,  // remainder dropped: no free level / price outside ladder range
+    UNKNOWN_ORDER,      // modify rejected: no resting order with this id
+    NOT_FILLABLE,       // FOK rejected: not enough crossing liquidity, book untouched
+    TIMER_EXHAUSTED,    // GTD remainder dropped: no free expiry timer
+    SELF_TRADE,         // some or all of the order was cancelled by self-trade prevention
+    AUCTION_REJECTED,   // rejected: only resting LIMIT / stop orders are taken during an auction
+    UNKNOWN_SYMBOL,     // rejected by the manager: symbol id has no book
+    OFF_TICK            // rejected by a gateway: price is not a whole number of ticks
 };
 
-class OrderBook {
+// Best bid / ask prices of a book; a missing side has price 0
+struct TopOfBook {
+    bool hasBid = false;
+    bool hasAsk = false;
+    Price bestBid = 0;
+    Price bestAsk = 0;
+
+    bool operator==(const TopOfBook&) const = default;
+};
+
+// Bits of what a book changed since its owner last took its changes
+// (BasicOrderBook::takeChanges). A depth bit means some displayed level of
+// that side changed size, order count or existence; BBO_CHANGED that a
+// best price ended up somewhere else.
+using BookChanges = uint8_t;
+constexpr BookChanges NO_CHANGE = 0;
+constexpr BookChanges BID_DEPTH_CHANGED = 1 << 0;
+constexpr BookChanges ASK_DEPTH_CHANGED = 1 << 1;
+constexpr BookChanges DEPTH_CHANGED = BID_DEPTH_CHANGED | ASK_DEPTH_CHANGED;
+constexpr BookChanges BBO_CHANGED = 1 << 2;
+
+// Which sides a mass cancel applies to
+enum class SideFilter {
+    BOTH,
+    BUY,
+    SELL
+};
+
+// Preallocated per-book storage. Nothing on the matching path allocates once
+// a book is built; orders beyond these limits are refused with a status.
+struct BookCapacity {
+    size_t orders = size_t(1) << 16;   // resting orders
+    size_t levels = size_t(1) << 12;   // price levels per side (ladder: initial ticks)
+    size_t stops = size_t(1) << 12;    // pending stop orders
+};
+
+// Where a live order is, for an engine-wide index by orderId shared by
+// several books (see OrderBookManager)
+struct OrderLocation {
+    SymbolId symbolId;
+    OrderNode* node;    // nullptr while it waits as an untriggered stop
+};
+
+using OrderIndex = OrderIdMap<OrderLocation>;
+
+// Order-type policies for the matching kernel (BasicOrderBook::match).
+// `crosses<S>(limit, best)` says whether an aggressor on side S may trade
+// against the opposite side's best price; `rests` whether an unfilled
+// remainder is added to the book. Both are resolved at compile time, so each
+// side x policy gets its own loop with no sentinel prices or type branches.
+// New order types plug in by adding a policy.
+struct LimitPolicy {
+    static constexpr bool rests = true;
+
+    template <Side S>
+    static constexpr bool crosses(Price limit, Price best) { return !isBetter<S>(best, limit); }
+};
+
+// Limit price, but nothing rests (IOC, and FOK once its precheck passed)
+struct IocPolicy {
+    static constexpr bool rests = false;
+
+    template <Side S>
+    static constexpr bool crosses(Price limit, Price best) { return LimitPolicy::crosses<S>(limit, best); }
+};
+
+struct MarketPolicy {
+    static constexpr bool rests = false;
+
+    template <Side S>
+    static constexpr bool crosses(Price, Price) { return true; }
+};
+
+// Allocation policies: how an aggressor is shared among the orders of a
+// price level it cannot clear. Chosen at compile time, so the FIFO kernel
+// carries no trace of the pro-rata code.
+struct FifoAllocation {
+    static constexpr bool proRata = false;   // strict time priority
+};
+
+struct ProRataAllocation {
+    static constexpr bool proRata = true;    // in proportion to displayed size
+};
+
+// Price-level book. `Levels` selects how each side stores its price levels
+// (see PriceLevels.hpp); `Allocation` how a level is shared out. All
+// combinations share the matching logic below.
+template <template <Side> class Levels, typename Allocation = FifoAllocation>
+class BasicOrderBook {
 public:
-    OrderBook();
+    explicit BasicOrderBook(double tickSize = DEFAULT_TICK_SIZE,
+                            const BookCapacity& capacity = BookCapacity());
+    ~BasicOrderBook();
 
-    // bids = highest price first
-    std::map<double, std::deque<Order>, DescendingPrice> bids;
+    // Levels hold raw pointers into the book's own node pool
+    BasicOrderBook(const BasicOrderBook&) = delete;
+    BasicOrderBook& operator=(const BasicOrderBook&) = delete;
 
-    // asks = lowest price first
-    std::map<double, std::deque<Order>> asks;
+    // Price increment of this book's symbol; all prices below are in ticks
+    double tickSize;
 
-    // Store mapping for cancellation
-    std::map<uint64_t, double> orderIdToPrice;
+    const BookCapacity capacity;
 
-    uint64_t nextTradeId = 1;
+    // Expiry timers of resting GTD orders, shared by every book of the
+    // owner (see OrderBookManager::expireOrders). Without one, GTD rests
+    // like GTC.
+    ExpiryWheel* expiries = nullptr;
+
+    // Index of live orders shared with the owner's other books, kept in
+    // step with the book's own orders and stops; orderIds must then be
+    // unique across all of them. Optional.
+    OrderIndex* index = nullptr;
+
+    // Pro-rata books only: the oldest order at a level fills first, in
+    // full, before the rest is shared out
+    bool topOrderPriority = false;
+
+    OrderStatus lastStatus = OrderStatus::ACCEPTED;
+
+    // Current best prices, moved only when a level is added or removed
+    TopOfBook top;
+
+    // Return and clear the changes collected since the previous call.
+    // BBO_CHANGED is only reported if `top` differs from what it was then.
+    BookChanges takeChanges();
+
+    // Match `order`, passing each fill to `onTrade`, and rest any LIMIT remainder
+    void addOrder(const Order& order, TradeSink onTrade);
+
+    // Append fills to a caller-owned buffer (not cleared first)
+    void addOrder(const Order& order, std::vector<Trade>& out);
 
     std::vector<Trade> addOrder(const Order& order);
 
+    void cancelOrder(uint64_t orderId);
+
+    // Cancel a GTD order whose expiry timer has just fired
+    void expireOrder(uint64_t orderId);
+
+    // Cancel every resting and pending stop order on the selected sides,
+    // limited to one owner unless ownerId is 0. With an owner, only that
+    // owner's list is walked, so the cost follows the orders removed, not
+    // the book size. Returns the number of orders cancelled.
+    size_t cancelAll(uint32_t ownerId, SideFilter sides);
+
+    // Change a resting order's price and/or quantity. A smaller quantity at
+    // the same price is applied in place and keeps queue priority; a larger
+    // quantity moves the order to the back of its level; a new price moves
+    // it through the matching kernel, so it can trade. Quantity 0 cancels.
+    void modifyOrder(uint64_t orderId, Price newPrice, uint32_t newQty, TradeSink onTrade);
+    void modifyOrder(uint64_t orderId, Price newPrice, uint32_t newQty, std::vector<Trade>& out);
+
+    // Enter the call auction phase: limit orders rest without matching, so
+    // the book may be crossed until uncross()
+    void startAuction();
+    bool isInAuction() const { return inAuction; }
+
+    // Leave the auction: execute everything that crosses at the one price
+    // that maximises matched volume (then least imbalance, then closest to
+    // the last trade), all fills in a single pass, and resume continuous
+    // matching. Crossing orders of one owner do not trade with each other:
+    // the later one's STP mode applies as if it had arrived after the
+    // auction, so the volume traded can fall short of the volume the price
+    // was chosen for. Returns the uncross price, or nullopt if nothing traded.
+    std::optional<Price> uncross(uint64_t timestamp, TradeSink onTrade);
+    std::optional<Price> uncross(uint64_t timestamp, std::vector<Trade>& out);
+
+    // No resting and no pending stop orders
+    bool empty() const { return bids.empty() && asks.empty() && stops.empty(); }
+
+    // An untriggered stop order, nullptr if none has this id
+    const Order* findStop(uint64_t orderId) const { return stops.find(orderId); }
+
     // Return top `levels` depth as a vector of DepthLevel. If `isBid` is true,
     // returns bid-side levels (highest-first), otherwise ask-side (lowest-first).
     std::vector<DepthLevel> getDepth(bool isBid, int levels) const;
+    // Same into `out`, which has room for `levels` entries; returns how many
+    // were written
+    size_t getDepth(bool isBid, DepthLevel* out, size_t levels) const;
 
-public:
-    std::vector<Trade> matchLimitBuy(Order order);
-    std::vector<Trade> matchLimitSell(Order order);
+    void printTopLevels() const;
 
-    std::vector<Trade> matchMarketBuy(Order order);
-    std::vector<Trade> matchMarketSell(Order order);
+private:
+    // bids = highest price first
+    Levels<Side::BUY> bids;
 
-    void insertLimitOrder(const Order& order);
-    void cancelOrder(uint64_t orderId);
+    // asks = lowest price first
+    Levels<Side::SELL> asks;
 
-public:
-    void printTopLevels() const;
+    // Storage for resting orders
+    ObjectPool<OrderNode> nodePool;
+
+    // Resting order handles by orderId, for O(1) cancellation
+    OrderIdMap<OrderNode*> orders;
+
+    // Head of each owner's intrusive list of resting orders, by ownerId
+    OrderIdMap<OrderNode*> ownerHeads;
+
+    // Untriggered stop orders, and the last trade price that triggers them
+    StopBook stops;
+    Price lastTradePrice = 0;
+    bool hasLastTrade = false;
+
+    // See startAuction()
+    bool inAuction = false;
+
+    uint64_t nextTradeId = 1;
+
+    // Changes collected since the last takeChanges(), and `top` as it was then
+    BookChanges changes = NO_CHANGE;
+    TopOfBook reportedTop;
+
+    // Match an aggressor on side S against the opposite side, then rest the
+    // remainder if the policy allows it
+    template <Side S, typename Policy>
+    void match(Order order, TradeSink onTrade);
+
+    // Pick the policy for an aggressor on side S from its type and time in force
+    template <Side S>
+    void route(const Order& order, TradeSink onTrade);
+
+    OrderStatus insertLimitOrder(const Order& order);
+
+    void linkOwner(OrderNode* node);
+    void unlinkOwner(OrderNode* node);
+
+    // Drop a node that is already off its level from every index, then free it
+    void releaseNode(OrderNode* node);
+    // Take a resting node off its level, then release it. Shared by cancel and
+    // expiry, which each report the removal themselves.
+    void removeResting(OrderNode* node);
+
+    // Change tracking. Every mutation of a level's displayed size or order
+    // count marks its side; adding or removing a level also keeps `top` in step.
+    void markDepth(Side side) { changes |= side == Side::BUY ? BID_DEPTH_CHANGED : ASK_DEPTH_CHANGED; }
+    void levelAdded(Side side, Price price);
+    // After the level at `price` was erased from its side
+    void levelRemoved(Side side, Price price);
+
+    // Drop an emptied level, or the best level of a side, through the above
+    void eraseLevel(Side side, Price price);
+    void popBestLevel(Side side);
+
+    // Trade `qty` of the aggressor on side S against `resting` at `price`
+    template <Side S>
+    void fillResting(Order& order, OrderNode* resting, uint32_t qty, Price price, TradeSink onTrade);
+
+    // Share the aggressor out over a level it cannot clear, in proportion to
+    // each order's displayed size, in one pass using the level total
+    template <Side S>
+    void allocateProRata(Order& order, PriceLevel& queue, Price price, uint32_t selfOwner, TradeSink onTrade);
+
+    // After a fill: refill an emptied iceberg from its reserve, or drop an
+    // emptied order. The caller removes the level if it ran empty.
+    void settle(OrderNode* node);
+
+    // Apply the aggressor's self-trade prevention mode against `resting`,
+    // the front order of the best opposite level
+    void preventSelfTrade(Order& order, OrderNode* resting);
+
+    // Fire every stop the last trade price has reached, including stops
+    // reached by trades of stops fired earlier in the same call
+    void releaseStops(TradeSink onTrade);
+
+    // FOK precheck: can `order` fill completely against the opposite side?
+    // Sums cached level totals best-first. With STP on, the owner's own
+    // crossing orders (found through its owner list) never count as
+    // liquidity, and only CANCEL_OLDEST lets the fill reach past them.
+    template <Side S, typename Policy>
+    bool canFill(const Order& order) const;
+
+    // Resting side an aggressor on side S trades against
+    template <Side S>
+    auto& oppositeLevels() {
+        if constexpr (S == Side::BUY) return asks;
+        else return bids;
+    }
+    template <Side S>
+    const auto& oppositeLevels() const {
+        if constexpr (S == Side::BUY) return asks;
+        else return bids;
+    }
 };
+
+// std::map-backed book
+using OrderBook = BasicOrderBook<MapLevels>;
+
+// Array-indexed price ladder book
+using LadderOrderBook = BasicOrderBook<LadderLevels>;
+
+// Pro-rata variants of both
+using ProRataOrderBook = BasicOrderBook<MapLevels, ProRataAllocation>;
+using ProRataLadderOrderBook = BasicOrderBook<LadderLevels, ProRataAllocation>;
@@ -1,38 +1,182 @@
 #pragma once
 
-#include <map>
+#include <span>
+#include <memory>
 #include <string>
 #include <vector>
 #include <cstdint>
+#include <variant>
 #include "OrderBook.hpp"
+#include "SymbolRegistry.hpp"
 
-// Small POD to store best bid/ask
-struct TopOfBook {
-    bool hasBid = false;
-    bool hasAsk = false;
-    double bestBid = 0.0;
-    double bestAsk = 0.0;
+// Level storage backend, chosen per symbol before its first order
+enum class BookType {
+    MAP,      // std::map of price levels (OrderBook)
+    LADDER    // array-indexed price ladder (LadderOrderBook)
 };
 
+// How a price level is shared out, chosen per symbol before its first order
+enum class MatchingRule {
+    FIFO,          // price-time priority
+    PRO_RATA,      // in proportion to resting size
+    PRO_RATA_TOP   // pro-rata after the oldest order at the level fills first
+};
+
+// A live order as found by its id alone (OrderBookManager::findOrder)
+struct OrderInfo {
+    SymbolId symbolId;
+    Side side;
+    OrderType type;
+    Price price;          // in ticks; 0 for MARKET / STOP
+    uint32_t openQty;     // displayed + iceberg reserve
+    bool pendingStop;     // untriggered stop, not in the book yet
+};
+
+using AnyOrderBook = std::variant<OrderBook, LadderOrderBook, ProRataOrderBook, ProRataLadderOrderBook>;
+
 class OrderBookManager {
     public:
-        OrderBookManager() : globalTradeId(1) {}
+        // `maxTimers` bounds the number of resting GTD orders across all
+        // books, `maxOrders` the number of live orders in the orderId index
+        explicit OrderBookManager(size_t maxTimers = size_t(1) << 16,
+                                  size_t maxOrders = size_t(1) << 17);
+
+        // Intern `symbol` and make sure it has a book. Gateways resolve the
+        // name once per message; everything after that works on the id.
+        SymbolId symbolId(const std::string& symbol);
+        // INVALID_SYMBOL if the symbol has never been seen
+        SymbolId findSymbol(const std::string& symbol) const { return symbols.find(symbol); }
+        const std::string& symbolName(SymbolId id) const { return symbols.name(id); }
+
+        // Routes on order.symbolId, which must come from symbolId().
+        // Fills reach `onTrade` as they happen, already carrying their global
+        // tradeId. `status` (optional) receives the book's verdict on the order.
+        void addOrder(const Order& order, TradeSink onTrade, OrderStatus* status = nullptr);
+
+        // Append fills to a caller-owned buffer (not cleared first), so hot
+        // callers can reuse one vector across orders
+        void addOrder(const Order& order, std::vector<Trade>& out, OrderStatus* status = nullptr);
+
+        std::vector<Trade> addOrder(const Order& order, OrderStatus* status = nullptr);
+
+        // Apply a batch in order, possibly across symbols. Fills stream out as
+        // they happen; top-of-book is diffed and published once per touched
+        // symbol after the whole batch. `statuses` (optional) must have room
+        // for batch.size() entries.
+        void addOrders(std::span<const Order> batch, TradeSink onTrade, OrderStatus* statuses = nullptr);
+        void addOrders(std::span<const Order> batch, std::vector<Trade>& out, OrderStatus* statuses = nullptr);
+
+        // Cancel all orders of `ownerId` (0 = every owner) on the selected
+        // sides of one symbol, or of every symbol for INVALID_SYMBOL. Each
+        // affected book publishes one consolidated top-of-book update.
+        // Returns the number of orders cancelled.
+        size_t massCancel(SymbolId symbol, uint32_t ownerId, SideFilter sides = SideFilter::BOTH);
 
-        std::vector<Trade> addOrder(const std::string& symbol, const Order& order);
-        void cancelOrder(const std::string& symbol, uint64_t orderId);
+        // Cancel every GTD order whose expireTime is at or before `now` (same
+        // clock as Order::timestamp). Call it from the engine loop; each book
+        // that lost orders publishes one top-of-book update. Returns the
+        // number of orders expired.
+        size_t expireOrders(uint64_t now);
+
+        // Opening / closing call auction for one symbol. While it runs, limit
+        // orders rest without matching. uncross() executes the auction at one
+        // price (see BasicOrderBook::uncross); its fills reach `onTrade` as a
+        // single batch with global tradeIds, followed by one top-of-book
+        // update. Both return false for an unknown symbol.
+        bool startAuction(SymbolId symbol);
+        bool uncross(SymbolId symbol, TradeSink onTrade);
+        bool uncross(SymbolId symbol, std::vector<Trade>& out);
+
+        // Symbols whose books the last addOrders / massCancel / expireOrders call touched
+        const std::vector<SymbolId>& touchedSymbols() const { return touched; }
+
+        // What the last call that touched this symbol changed in its book
+        // (BookChanges bits, BBO_CHANGED when a top update went out), so
+        // gateways can skip depth snapshots of books that did not move
+        BookChanges changesOf(SymbolId symbol) const {
+            return symbol < lastChanges.size() ? lastChanges[symbol] : NO_CHANGE;
+        }
+        void cancelOrder(SymbolId symbol, uint64_t orderId);
+
+        // By orderId alone: one probe of the engine-wide index finds the
+        // order's book, whatever its symbol. OrderIds are unique across
+        // symbols (a reused live id is DUPLICATE_ID). cancelOrder returns
+        // false and modifyOrder reports UNKNOWN_ORDER for an unknown id.
+        bool cancelOrder(uint64_t orderId);
+        void modifyOrder(uint64_t orderId, Price newPrice, uint32_t newQty,
+                         TradeSink onTrade, OrderStatus* status = nullptr);
+        void modifyOrder(uint64_t orderId, Price newPrice, uint32_t newQty,
+                         std::vector<Trade>& out, OrderStatus* status = nullptr);
+        // False if no resting or pending stop order has this id
+        bool findOrder(uint64_t orderId, OrderInfo& out) const;
+
+        // Reprice and/or resize a resting order (see BasicOrderBook::modifyOrder).
+        // `newPrice` is in ticks. Fills from a repriced order go to `onTrade`.
+        void modifyOrder(SymbolId symbol, uint64_t orderId, Price newPrice, uint32_t newQty,
+                         TradeSink onTrade, OrderStatus* status = nullptr);
+        void modifyOrder(SymbolId symbol, uint64_t orderId, Price newPrice, uint32_t newQty,
+                         std::vector<Trade>& out, OrderStatus* status = nullptr);
 
         void printTopLevels() const;                  // print all symbols
         void printTopLevels(const std::string& symbol) const; // print specific symbol
 
-        OrderBook* getOrderBook(const std::string& symbol);
+        // Top `levels` of one side of a symbol's book (empty if no book yet)
+        std::vector<DepthLevel> getDepth(SymbolId symbol, bool isBid, int levels) const;
+        // Into a buffer with room for `levels` entries; returns how many were written
+        size_t getDepth(SymbolId symbol, bool isBid, DepthLevel* out, size_t levels) const;
+
+        // Per-symbol tick size. Must be set before the symbol's first order;
+        // returns false if the book already holds resting or pending stop
+        // orders, which would otherwise be lost or mispriced.
+        bool setTickSize(const std::string& symbol, double tickSize);
+        double tickSize(SymbolId symbol) const;
+
+        // Per-symbol book backend, same rules as setTickSize. Symbols that are
+        // not configured explicitly use the default type.
+        bool setBookType(const std::string& symbol, BookType type);
+        void setDefaultBookType(BookType type) { defaultBookType = type; }
+
+        // Per-symbol matching rule, same rules as setBookType
+        bool setMatchingRule(const std::string& symbol, MatchingRule rule);
+        void setDefaultMatchingRule(MatchingRule rule) { defaultMatchingRule = rule; }
+
+        // Preallocated order/level pool sizes, same rules as setBookType
+        bool setBookCapacity(const std::string& symbol, const BookCapacity& capacity);
+        void setDefaultCapacity(const BookCapacity& capacity) { defaultCapacity = capacity; }
+
+        // Trade ids run first, first + stride, ...; managers that share one
+        // id space (see ShardedOrderBookManager) take interleaved sequences
+        void setTradeIdSequence(uint64_t first, uint64_t stride);
+
+        // Trade and top-of-book lines through MarketDataServerAPI (on by
+        // default). Shards turn them off and publish through their own rings.
+        void setMarketData(bool on) { marketData = on; }
 
     private:
-        std::map<std::string, OrderBook> books;
-        std::map<std::string, TopOfBook> prevTop; // track previous top-of-book per symbol
+        SymbolRegistry symbols;
+        // Declared before the books, whose nodes hold timers from it
+        ExpiryWheel expiries;
+        std::vector<OrderExpiry> expired; // reused by expireOrders
+        // Every live order's book and node, by orderId; also before the books
+        OrderIndex orderIndex;
+        // Indexed by SymbolId. Books are heap-allocated once so growing the
+        // table never moves them.
+        std::vector<std::unique_ptr<AnyOrderBook>> books;
+        std::vector<BookChanges> lastChanges; // by SymbolId, see changesOf()
+        BookType defaultBookType = BookType::MAP;
+        MatchingRule defaultMatchingRule = MatchingRule::FIFO;
+        BookCapacity defaultCapacity;
         uint64_t globalTradeId;
+        uint64_t tradeIdStride = 1;
+        bool marketData = true;
+        std::vector<SymbolId> touched;  // reused by addOrders / massCancel / expireOrders
 
         // helpers
-        TopOfBook snapshotTop(const std::string& symbol) const;
-        void emitMarketDataTop(const std::string& symbol, const TopOfBook& top) const;
-        void emitTradeMD(const Trade& t, const std::string& symbol) const;
+        uint64_t takeTradeId();
+        void executeOrder(AnyOrderBook& book, const Order& order, TradeSink onTrade, OrderStatus* status);
+        AnyOrderBook* findBook(SymbolId symbol) const;
+        // Take the book's collected changes and broadcast its top if it moved
+        void publishChanges(SymbolId symbol, AnyOrderBook& book);
+        void emitMarketDataTop(SymbolId symbol, const TopOfBook& top, double tickSize) const;
+        void emitTradeMD(const Trade& t, double tickSize) const;
 };
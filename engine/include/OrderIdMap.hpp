@@ -0,0 +1,102 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Open-addressing hash map keyed by orderId, sized once at construction.
+// Linear probing with backward-shift deletion (no tombstones), so lookups stay
+// short and inserts/erases never allocate. Holds at most capacity/2 entries;
+// insert() fails beyond that.
+template <typename V>
+class OrderIdMap {
+public:
+    explicit OrderIdMap(size_t maxEntries)
+        : slots(roundUpPow2(maxEntries * 2)), mask(slots.size() - 1),
+          shift(64 - log2(slots.size())) {}
+
+    size_t size() const { return count; }
+
+    V* find(uint64_t key) {
+        for (size_t i = home(key);; i = (i + 1) & mask) {
+            Slot& s = slots[i];
+            if (!s.used) return nullptr;
+            if (s.key == key) return &s.value;
+        }
+    }
+
+    const V* find(uint64_t key) const {
+        return const_cast<OrderIdMap*>(this)->find(key);
+    }
+
+    bool contains(uint64_t key) const { return find(key) != nullptr; }
+
+    // False if the key is already present or the map is full
+    bool insert(uint64_t key, const V& value) {
+        if (count * 2 >= slots.size()) return false;
+        size_t i = home(key);
+        for (; slots[i].used; i = (i + 1) & mask) {
+            if (slots[i].key == key) return false;
+        }
+        slots[i] = Slot{key, value, true};
+        ++count;
+        return true;
+    }
+
+    bool erase(uint64_t key) {
+        size_t i = home(key);
+        for (;; i = (i + 1) & mask) {
+            if (!slots[i].used) return false;
+            if (slots[i].key == key) break;
+        }
+
+        // Shift later members of the probe run back into the hole
+        for (size_t j = (i + 1) & mask; slots[j].used; j = (j + 1) & mask) {
+            size_t h = home(slots[j].key);
+            bool movable = (i <= j) ? (h <= i || h > j) : (h <= i && h > j);
+            if (movable) {
+                slots[i] = slots[j];
+                i = j;
+            }
+        }
+        slots[i].used = false;
+        --count;
+        return true;
+    }
+
+    template <typename F>
+    void forEach(F&& f) const {
+        for (const Slot& s : slots) {
+            if (s.used) f(s.key, s.value);
+        }
+    }
+
+private:
+    struct Slot {
+        uint64_t key = 0;
+        V value{};
+        bool used = false;
+    };
+
+    std::vector<Slot> slots;
+    size_t mask;
+    unsigned shift;
+    size_t count = 0;
+
+    static size_t roundUpPow2(size_t n) {
+        size_t cap = 2;
+        while (cap < n) cap <<= 1;
+        return cap;
+    }
+
+    static unsigned log2(size_t n) {
+        unsigned b = 0;
+        while ((size_t(1) << b) < n) ++b;
+        return b;
+    }
+
+    // Fibonacci hashing: sequential ids spread across the table
+    size_t home(uint64_t key) const {
+        return size_t((key * 0x9E3779B97F4A7C15ULL) >> shift);
+    }
+};
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include "PriceLevels.hpp"
+#include "OccupancyBitmap.hpp"
+
+// Maximum number of ticks a ladder side can span
+constexpr size_t LADDER_MAX_TICKS = size_t(1) << 20;
+
+// One side of a book stored as a contiguous array of price levels indexed by
+// tick. The array is used as a ring: price p lives in slot (p & mask), and the
+// window [lo, lo + capacity) of representable prices slides with the market.
+// As long as the occupied range fits in the window, recentering is just moving
+// `lo` - no level is copied. The ring only grows (and rehashes) when the
+// occupied range gets wider than the capacity. Levels live inline in the
+// array, so apart from growth the ladder never allocates. An occupancy bitmap
+// over the slots finds the next non-empty level after a sweep or cancel
+// without visiting the empty ticks in between.
+template <Side S>
+class LadderLevels {
+public:
+    // `capacity` is the initial span in ticks
+    explicit LadderLevels(size_t capacity)
+        : slots(roundUpPow2(capacity)), mask(slots.size() - 1), occupied(slots.size()) {}
+
+    bool empty() const { return count == 0; }
+    size_t size() const { return count; }
+
+    Price bestPrice() const { return bestPx; }
+    PriceLevel& best() { return slot(bestPx); }
+    const PriceLevel& best() const { return slot(bestPx); }
+
+    PriceLevel* find(Price price) {
+        if (count == 0 || !inWindow(price)) return nullptr;
+        auto& level = slot(price);
+        return level.empty() ? nullptr : &level;
+    }
+
+    PriceLevel* at(Price price) {
+        if (count == 0) {
+            lo = price - Price(slots.size() / 2);
+        } else if (!inWindow(price) && !recenter(price)) {
+            return nullptr;
+        }
+
+        auto& level = slot(price);
+        if (level.empty()) {
+            if (count == 0) {
+                bestPx = worstPx = price;
+            } else {
+                if (isBetter<S>(price, bestPx)) bestPx = price;
+                if (isBetter<S>(worstPx, price)) worstPx = price;
+            }
+            occupied.set(index(price));
+            ++count;
+        }
+        return &level;
+    }
+
+    void erase(Price price) {
+        occupied.clear(index(price));
+        if (--count == 0) return;
+        if (price == bestPx) bestPx = nextOccupied(price, worse(1));
+        if (price == worstPx) worstPx = nextOccupied(price, -worse(1));
+    }
+
+    void popBest() { erase(bestPx); }
+
+    template <typename F>
+    void forEach(F&& f) const {
+        if (count == 0) return;
+        for (Price p = bestPx;; p = nextOccupied(p, worse(1))) {
+            if (!f(p, slot(p))) break;
+            if (p == worstPx) break;
+        }
+    }
+
+private:
+    std::vector<PriceLevel> slots;
+    uint64_t mask;
+    Price lo = 0;        // anchor: lowest price representable in the window
+    Price bestPx = 0;    // exact best and worst occupied prices
+    Price worstPx = 0;
+    size_t count = 0;    // non-empty levels
+    OccupancyBitmap occupied; // one bit per slot, set while the level is non-empty
+
+    static size_t roundUpPow2(size_t n) {
+        size_t cap = 1;
+        while (cap < n) cap <<= 1;
+        return cap;
+    }
+
+    // Signed step from better to worse prices
+    static constexpr Price worse(Price ticks) {
+        return S == Side::BUY ? -ticks : ticks;
+    }
+
+    bool inWindow(Price price) const {
+        return price >= lo && uint64_t(price - lo) < slots.size();
+    }
+
+    size_t index(Price price) const { return uint64_t(price) & mask; }
+    PriceLevel& slot(Price price) { return slots[index(price)]; }
+    const PriceLevel& slot(Price price) const { return slots[index(price)]; }
+
+    // First non-empty level strictly past `from` in direction `step` (+1/-1).
+    // Only called while at least one such level is occupied. Every occupied
+    // price lies inside the window, so walking the ring from `from`'s slot
+    // and wrapping once reaches it; the slot distance is the tick distance.
+    Price nextOccupied(Price from, Price step) const {
+        size_t s = index(from);
+        size_t found;
+        if (step > 0) {
+            found = occupied.next(s + 1);
+            if (found == OccupancyBitmap::npos) found = occupied.next(0);
+            return from + Price((found - s) & mask);
+        }
+        found = s > 0 ? occupied.prev(s - 1) : OccupancyBitmap::npos;
+        if (found == OccupancyBitmap::npos) found = occupied.prev(mask);
+        return from - Price((s - found) & mask);
+    }
+
+    // Slide (and if necessary widen) the window so it covers `price` as well
+    // as every occupied level. Returns false if the span exceeds the maximum.
+    bool recenter(Price price) {
+        Price low = std::min({price, bestPx, worstPx});
+        Price high = std::max({price, bestPx, worstPx});
+        uint64_t span = uint64_t(high - low) + 1;
+        if (span > LADDER_MAX_TICKS) return false;
+        if (span > slots.size()) grow(span);
+
+        lo = low - Price((slots.size() - span) / 2);
+        return true;
+    }
+
+    void grow(uint64_t span) {
+        std::vector<PriceLevel> bigger(roundUpPow2(std::min<uint64_t>(span * 2, LADDER_MAX_TICKS)));
+        uint64_t biggerMask = bigger.size() - 1;
+        OccupancyBitmap biggerOccupied(bigger.size());
+        for (Price p = bestPx;; p = nextOccupied(p, worse(1))) {
+            auto& moved = bigger[uint64_t(p) & biggerMask];
+            moved = slot(p);
+            moved.adoptNodes();
+            biggerOccupied.set(uint64_t(p) & biggerMask);
+            if (p == worstPx) break;
+        }
+        slots.swap(bigger);
+        occupied = std::move(biggerOccupied);
+        mask = biggerMask;
+    }
+};
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <map>
+#include <algorithm>
+#include <functional>
+#include <type_traits>
+#include "Order.hpp"
+#include "ObjectPool.hpp"
+#include "TimerWheel.hpp"
+
+struct PriceLevel;
+
+// A resting order. Doubles as the handle the book's orderId index points to,
+// so cancelling is a hash lookup followed by an O(1) unlink.
+struct OrderNode {
+    Order order;
+    OrderNode* prev = nullptr;
+    OrderNode* next = nullptr;
+    PriceLevel* level = nullptr;
+    uint32_t reserve = 0;   // hidden iceberg quantity behind order.quantity
+
+    // Links in the owner's list of resting orders (see BasicOrderBook::cancelAll)
+    OrderNode* ownerPrev = nullptr;
+    OrderNode* ownerNext = nullptr;
+
+    // Pending expiry of a resting GTD order
+    ExpiryWheel::Timer* expiry = nullptr;
+};
+
+// Resting orders at one price, oldest first, as an intrusive doubly linked
+// FIFO. The level does not own its nodes. Running totals are kept in step
+// with every insert, fill and cancel so depth never walks the queue.
+// totalQty is the displayed size; iceberg reserves are summed separately.
+struct PriceLevel {
+    OrderNode* head = nullptr;
+    OrderNode* tail = nullptr;
+    uint64_t totalQty = 0;
+    uint64_t hiddenQty = 0;
+    uint32_t orderCount = 0;
+
+    bool empty() const { return head == nullptr; }
+    OrderNode* front() const { return head; }
+
+    void pushBack(OrderNode* node) {
+        node->level = this;
+        node->prev = tail;
+        node->next = nullptr;
+        if (tail) tail->next = node;
+        else head = node;
+        tail = node;
+        totalQty += node->order.quantity;
+        hiddenQty += node->reserve;
+        ++orderCount;
+    }
+
+    // Partial or full fill of a queued order, or an in-place size reduction
+    void fill(OrderNode* node, uint32_t qty) {
+        node->order.quantity -= qty;
+        totalQty -= qty;
+    }
+
+    void unlink(OrderNode* node) {
+        if (node->prev) node->prev->next = node->next;
+        else head = node->next;
+        if (node->next) node->next->prev = node->prev;
+        else tail = node->prev;
+        node->prev = node->next = nullptr;
+        node->level = nullptr;
+        totalQty -= node->order.quantity;
+        hiddenQty -= node->reserve;
+        --orderCount;
+    }
+
+    // Iceberg peak used up: display the next slice of the reserve and
+    // requeue the order at the back of this level
+    void replenish(OrderNode* node, uint32_t peak) {
+        unlink(node);
+        uint32_t slice = std::min(peak, node->reserve);
+        node->reserve -= slice;
+        node->order.quantity = slice;
+        pushBack(node);
+    }
+
+    // In-place cut of an iceberg's hidden quantity
+    void shrinkReserve(OrderNode* node, uint32_t qty) {
+        node->reserve -= qty;
+        hiddenQty -= qty;
+    }
+
+    // Re-point every node at this level after the level object was moved
+    void adoptNodes() {
+        for (OrderNode* n = head; n; n = n->next) n->level = this;
+    }
+};
+
+// True if price `a` has priority over `b` on side S
+template <Side S>
+constexpr bool isBetter(Price a, Price b) {
+    if constexpr (S == Side::BUY) return a > b;
+    else return a < b;
+}
+
+// Comparator: highest price first (for bids)
+struct DescendingPrice {
+    bool operator()(Price a, Price b) const {
+        return a > b;       // higher prices come first
+    }
+};
+
+// One side of a book stored as a red-black tree of price levels. Tree nodes
+// come from a per-side SlabPool of `capacity` levels.
+//
+// Every level container used by BasicOrderBook is constructed from a level
+// capacity and exposes the same interface:
+//   empty(), size()             - number of non-empty levels
+//   bestPrice(), best()         - best level (precondition: !empty())
+//   find(price)                 - level at price, nullptr if none
+//   at(price)                   - level at price, created if missing; nullptr
+//                                 if the container cannot represent the price
+//                                 or has no free level.
+//                                 The caller must add an order to a new level.
+//   erase(price), popBest()     - drop a level that has become empty
+//   forEach(f)                  - visit (price, level) best-first while f returns true
+template <Side S>
+class MapLevels {
+public:
+    using Compare = std::conditional_t<S == Side::BUY, DescendingPrice, std::less<Price>>;
+    using Value = std::pair<const Price, PriceLevel>;
+
+    explicit MapLevels(size_t capacity)
+        : levelPool(sizeof(Value) + 4 * sizeof(void*), capacity),
+          levels(Compare(), PoolAllocator<Value>(&levelPool)) {}
+
+    bool empty() const { return levels.empty(); }
+    size_t size() const { return levels.size(); }
+
+    Price bestPrice() const { return levels.begin()->first; }
+    PriceLevel& best() { return levels.begin()->second; }
+    const PriceLevel& best() const { return levels.begin()->second; }
+
+    PriceLevel* find(Price price) {
+        auto it = levels.find(price);
+        return it == levels.end() ? nullptr : &it->second;
+    }
+
+    PriceLevel* at(Price price) {
+        auto it = levels.lower_bound(price);
+        if (it != levels.end() && it->first == price) return &it->second;
+        if (levelPool.available() == 0) return nullptr;
+        return &levels.emplace_hint(it, price, PriceLevel{})->second;
+    }
+
+    void erase(Price price) { levels.erase(price); }
+    void popBest() { levels.erase(levels.begin()); }
+
+    template <typename F>
+    void forEach(F&& f) const {
+        for (auto it = levels.begin(); it != levels.end(); ++it) {
+            if (!f(it->first, it->second)) break;
+        }
+    }
+
+private:
+    // Sized for a libstdc++-style tree node: header (color + 3 links) + value
+    SlabPool levelPool;
+    std::map<Price, PriceLevel, Compare, PoolAllocator<Value>> levels;
+};
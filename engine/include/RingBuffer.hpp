@@ -0,0 +1,171 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <utility>
+
+// Size of a cache line; hot atomics are padded to this to avoid false sharing
+constexpr size_t CACHE_LINE = 64;
+
+// Bounded lock-free multi-producer / single-consumer ring (Vyukov-style).
+// Each cell carries a sequence number that tells producers and the consumer
+// whose turn it is, so producers only contend on one fetch of `head` and
+// never block each other. tryPush fails (instead of waiting) when full.
+// N must be a power of two.
+template <typename T, size_t N>
+class MpscRing {
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "ring size must be a power of two");
+
+public:
+    MpscRing() {
+        for (size_t i = 0; i < N; ++i) cells[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    MpscRing(const MpscRing&) = delete;
+    MpscRing& operator=(const MpscRing&) = delete;
+
+    // Claim a cell and let `fill(T&)` write the message in place.
+    // Returns false if the ring is full.
+    template <typename F>
+    bool tryPushWith(F&& fill) {
+        size_t pos = head.load(std::memory_order_relaxed);
+        Cell* cell;
+        for (;;) {
+            cell = &cells[pos & (N - 1)];
+            size_t seq = cell->seq.load(std::memory_order_acquire);
+            intptr_t diff = intptr_t(seq) - intptr_t(pos);
+            if (diff == 0) {
+                if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = head.load(std::memory_order_relaxed);
+            }
+        }
+        fill(cell->data);
+        cell->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool tryPush(const T& value) {
+        return tryPushWith([&](T& slot) { slot = value; });
+    }
+
+    // Consumer side only
+    bool tryPop(T& out) {
+        Cell& cell = cells[tail & (N - 1)];
+        size_t seq = cell.seq.load(std::memory_order_acquire);
+        if (intptr_t(seq) - intptr_t(tail + 1) < 0) return false;
+        out = std::move(cell.data);
+        cell.seq.store(tail + N, std::memory_order_release);
+        ++tail;
+        return true;
+    }
+
+private:
+    struct alignas(CACHE_LINE) Cell {
+        std::atomic<size_t> seq;
+        T data;
+    };
+
+    std::array<Cell, N> cells;
+    alignas(CACHE_LINE) std::atomic<size_t> head{0};
+    alignas(CACHE_LINE) size_t tail = 0;
+};
+
+// Bounded lock-free single-producer / single-consumer ring. Each side owns
+// one index on its own cache line and keeps a cached copy of the other's,
+// so the shared line is read only when the cached view says full / empty.
+// tryPush fails (instead of waiting) when full. N must be a power of two.
+template <typename T, size_t N>
+class SpscRing {
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "ring size must be a power of two");
+
+public:
+    SpscRing() = default;
+
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    // Producer side only: let `fill(T&)` write the next message in place.
+    // Returns false if the ring is full.
+    template <typename F>
+    bool tryPushWith(F&& fill) {
+        size_t pos = head.load(std::memory_order_relaxed);
+        if (pos - tailCache == N) {
+            tailCache = tail.load(std::memory_order_acquire);
+            if (pos - tailCache == N) return false;
+        }
+        fill(slots[pos & (N - 1)]);
+        head.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool tryPush(const T& value) {
+        return tryPushWith([&](T& slot) { slot = value; });
+    }
+
+    // Consumer side only
+    bool tryPop(T& out) {
+        size_t pos = tail.load(std::memory_order_relaxed);
+        if (pos == headCache) {
+            headCache = head.load(std::memory_order_acquire);
+            if (pos == headCache) return false;
+        }
+        out = std::move(slots[pos & (N - 1)]);
+        tail.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    alignas(CACHE_LINE) std::array<T, N> slots;
+    // Producer's line
+    alignas(CACHE_LINE) std::atomic<size_t> head{0};
+    size_t tailCache = 0;
+    // Consumer's line
+    alignas(CACHE_LINE) std::atomic<size_t> tail{0};
+    size_t headCache = 0;
+};
+
+// What a thread polling rings does when they are all empty: spin with a
+// CPU pause first, then yield, then sleep briefly. A hot consumer reacts
+// within nanoseconds; one idle for longer gives its core away and wakes
+// within SLEEP. Call wait() after every empty poll and reset() after work.
+class IdleBackoff {
+public:
+    static constexpr unsigned SPINS = 1024;
+    static constexpr unsigned YIELDS = 64;
+    static constexpr std::chrono::microseconds SLEEP{50};
+
+    void reset() { idle = 0; }
+
+    void wait() {
+        if (idle < SPINS) {
+            cpuRelax();
+            ++idle;
+        } else if (idle < SPINS + YIELDS) {
+            std::this_thread::yield();
+            ++idle;
+        } else {
+            std::this_thread::sleep_for(SLEEP);
+        }
+    }
+
+    // Past the spinning phase: cheap enough to look at a clock
+    bool settled() const { return idle >= SPINS; }
+
+private:
+    unsigned idle = 0;
+
+    static void cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#elif defined(__aarch64__)
+        asm volatile("yield");
+#endif
+    }
+};
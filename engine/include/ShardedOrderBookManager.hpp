@@ -0,0 +1,237 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include "OrderBookManager.hpp"
+#include "RingBuffer.hpp"
+#include "SymbolRegistry.hpp"
+
+// Book settings a symbol is created with (see the OrderBookManager setters)
+struct SymbolConfig {
+    double tickSize = DEFAULT_TICK_SIZE;
+    BookType type = BookType::MAP;
+    MatchingRule rule = MatchingRule::FIFO;
+    BookCapacity capacity;
+};
+
+// Longest symbol name a shard request can carry
+constexpr size_t MAX_SYMBOL_NAME = 31;
+
+// Levels per side in a DEPTH event
+constexpr size_t SHARD_DEPTH_LEVELS = 10;
+
+// Fixed-size command from the gateway to a shard's matching thread.
+// Symbol ids are the gateway's.
+struct ShardRequest {
+    enum class Kind : uint8_t { ADD_SYMBOL, NEW, BATCH, CANCEL, MODIFY, MASS_CANCEL, AUCTION, UNCROSS };
+
+    Kind kind;
+    SymbolId symbolId;                // INVALID_SYMBOL: mass cancel every symbol of the shard,
+                                      // or cancel / modify by orderId alone
+    uint64_t seq;                     // gateway's stamp (see setStamp), echoed on
+    uint64_t timestamp;               // every event the request causes
+    Order order;                      // NEW / BATCH
+    bool batchEnd;                    // BATCH: last order of the batch for this shard
+    uint64_t orderId;                 // CANCEL / MODIFY
+    Price price;                      // MODIFY with a symbol
+    double decimalPrice;              // MODIFY by orderId alone; the shard converts it
+    uint32_t quantity;                // MODIFY
+    uint32_t ownerId;                 // MASS_CANCEL
+    SideFilter sides;                 // MASS_CANCEL
+    SymbolConfig config;              // ADD_SYMBOL
+    char name[MAX_SYMBOL_NAME + 1];   // ADD_SYMBOL
+};
+
+// Fixed-size result from a shard's matching thread, with gateway symbol ids
+struct ShardEvent {
+    enum class Kind : uint8_t {
+        TRADE,      // one fill, global tradeId
+        STATUS,     // verdict on a NEW, BATCH order or MODIFY
+        DEPTH,      // book snapshot after a request changed it (publishDepth only)
+        UNCROSSED   // an UNCROSS is done; its fills came just before
+    };
+
+    Kind kind;
+    SymbolId symbolId;
+    uint64_t seq;                     // stamp of the request behind the event;
+    uint64_t requestTs;               // both 0 for a GTD expiry
+    Trade trade;                      // TRADE
+    uint64_t orderId;                 // STATUS
+    OrderStatus status;               // STATUS
+    uint32_t bidCount;                // DEPTH: used entries of bids / asks
+    uint32_t askCount;
+    std::array<DepthLevel, SHARD_DEPTH_LEVELS> bids;
+    std::array<DepthLevel, SHARD_DEPTH_LEVELS> asks;
+};
+
+// Outcome of handing a request to a shard
+enum class SubmitStatus {
+    QUEUED,
+    QUEUE_FULL,       // the shard's ring is full: poll() and retry
+    UNKNOWN_SYMBOL    // symbol id was never returned by addSymbol
+};
+
+// Symbol-sharded matching across cores. Symbols are spread round-robin over
+// N matching threads, each pinned to a CPU and owning the OrderBookManager
+// of its symbols outright, so no book is ever touched by two threads and
+// nothing on the matching path takes a lock. The gateway reaches a shard
+// only through bounded lock-free single-producer rings of fixed-size
+// messages: requests in, fills / statuses / depth snapshots out.
+//
+// A symbol lives on one shard and its requests are applied in the order
+// they entered that shard's ring, so per-symbol sequencing is the gateway's;
+// different shards run in parallel. Trade ids are unique across shards
+// (shard k issues k+1, k+1+N, ...) but ordered only within a symbol.
+//
+// Everything except poll() is for one gateway thread (the symbol table is
+// not synchronised); poll() is for one consumer thread, possibly another.
+// A shard whose outgoing ring is full waits for poll(), so a gateway that
+// gets QUEUE_FULL should poll() before it retries.
+class ShardedOrderBookManager {
+    public:
+        // `cpus[k]` is the CPU shard k is pinned to (-1 leaves it unpinned);
+        // by default shard k takes CPU k. With `publishDepth`, every request
+        // that changes a book's displayed levels is followed by a DEPTH
+        // event for it.
+        explicit ShardedOrderBookManager(size_t shards, std::vector<int> cpus = {},
+                                         bool publishDepth = false);
+        ~ShardedOrderBookManager();
+
+        ShardedOrderBookManager(const ShardedOrderBookManager&) = delete;
+        ShardedOrderBookManager& operator=(const ShardedOrderBookManager&) = delete;
+
+        // Register a symbol with its book settings and return its id; an
+        // existing symbol keeps its id and settings. INVALID_SYMBOL if the
+        // name is too long or the shard's ring is full.
+        SymbolId addSymbol(const std::string& symbol, const SymbolConfig& config = SymbolConfig());
+        // INVALID_SYMBOL if the symbol was never added
+        SymbolId findSymbol(const std::string& symbol) const { return symbols.find(symbol); }
+        const std::string& symbolName(SymbolId id) const { return symbols.name(id); }
+        double tickSize(SymbolId symbol) const { return tickSizes[symbol]; }
+
+        size_t shardCount() const { return shards.size(); }
+
+        // A fresh order id for `symbol`. The id names the symbol's shard
+        // (id % N), so orders entered with one can be cancelled or modified
+        // by id alone.
+        uint64_t newOrderId(SymbolId symbol) { return nextOrderSeq++ * shards.size() + shardOf(symbol); }
+
+        // Sequence number and arrival time the following requests carry to
+        // their events, e.g. the gateway's stamp of the client command
+        void setStamp(uint64_t seq, uint64_t timestamp) {
+            stampSeq = seq;
+            stampTs = timestamp;
+        }
+
+        // Requests, routed on the symbol id (order.symbolId for submit).
+        // Answers come back through poll(): fills for all of them, a STATUS
+        // for submit and modify.
+        SubmitStatus submit(const Order& order);
+        SubmitStatus cancel(SymbolId symbol, uint64_t orderId);
+        SubmitStatus modify(SymbolId symbol, uint64_t orderId, Price newPrice, uint32_t newQty);
+        SubmitStatus startAuction(SymbolId symbol);
+        SubmitStatus uncross(SymbolId symbol);
+
+        // Orders possibly across symbols and shards, each shard's part applied
+        // with one OrderBookManager::addOrders call: one STATUS per order, and
+        // one DEPTH event per symbol for the whole batch. Orders are queued
+        // from the front and `queued` says how many went. On QUEUE_FULL,
+        // poll() and pass the rest before sending anything else: the shards
+        // hold their part until it is complete. UNKNOWN_SYMBOL queues nothing.
+        SubmitStatus submit(std::span<const Order> batch, size_t& queued);
+
+        // By an id from newOrderId() alone: the shard looks the order up in
+        // its books. `newPrice` is a decimal price, converted with the tick
+        // size of the order's symbol. An unknown id is logged; modifying one
+        // gets an UNKNOWN_ORDER status with symbol INVALID_SYMBOL.
+        SubmitStatus cancel(uint64_t orderId);
+        SubmitStatus modify(uint64_t orderId, double newPrice, uint32_t newQty);
+
+        // INVALID_SYMBOL goes to every shard. On QUEUE_FULL the shards that
+        // did take it still cancel; retrying the whole call is harmless.
+        SubmitStatus massCancel(SymbolId symbol, uint32_t ownerId, SideFilter sides = SideFilter::BOTH);
+
+        // Pass every event the shards have produced so far to onEvent(const
+        // ShardEvent&). Events of one symbol arrive in the order they
+        // happened. Returns the number of events.
+        template <typename F>
+        size_t poll(F&& onEvent) {
+            size_t n = 0;
+            for (auto& shard : shards) {
+                while (shard->outbox.tryPop(event)) {
+                    onEvent(event);
+                    ++n;
+                }
+            }
+            return n;
+        }
+
+        // Let every shard apply what is queued, then join the threads. Events
+        // that no longer fit a full outgoing ring are dropped from here on.
+        // Called by the destructor.
+        void stop();
+
+    private:
+        static constexpr size_t QUEUE_SIZE = size_t(1) << 12;
+
+        struct Shard {
+            OrderBookManager books;   // shard-local symbol ids
+            SpscRing<ShardRequest, QUEUE_SIZE> inbox;    // gateway -> shard
+            SpscRing<ShardEvent, QUEUE_SIZE> outbox;     // shard -> poll()
+            int cpu = -1;
+            std::thread thread;
+            uint64_t seq = 0;         // stamp for the events being published
+            uint64_t requestTs = 0;
+            std::vector<Order> batch;               // BATCH orders until batchEnd
+            std::vector<OrderStatus> batchStatus;   // reused by BATCH
+        };
+
+        SymbolRegistry symbols;
+        std::vector<double> tickSizes;  // by gateway SymbolId
+        std::vector<std::unique_ptr<Shard>> shards;
+        const bool publishDepth;
+        std::atomic<bool> running{true};
+        ShardEvent event;               // poll()'s landing slot
+        uint64_t nextOrderSeq = 1;      // see newOrderId()
+        uint64_t stampSeq = 0;          // see setStamp()
+        uint64_t stampTs = 0;
+        std::vector<size_t> lastOfShard;  // scratch for submit(batch)
+
+        // Gateway id g lives on shard g % N as local id g / N: each shard
+        // interns its symbols in gateway order, so no table is needed
+        size_t shardOf(SymbolId symbol) const { return symbol % shards.size(); }
+        SymbolId localId(SymbolId symbol) const { return SymbolId(symbol / shards.size()); }
+        SymbolId gatewayId(size_t shard, SymbolId local) const {
+            return SymbolId(local * shards.size() + shard);
+        }
+
+        // Fill a request in place on a shard's ring, stamped
+        template <typename F>
+        bool push(size_t shard, SymbolId symbol, F&& fill) {
+            return shards[shard]->inbox.tryPushWith([&](ShardRequest& r) {
+                r.symbolId = symbol;
+                r.seq = stampSeq;
+                r.timestamp = stampTs;
+                fill(r);
+            });
+        }
+        // Likewise on the symbol's shard
+        template <typename F>
+        SubmitStatus send(SymbolId symbol, F&& fill) {
+            if (!symbols.contains(symbol)) return SubmitStatus::UNKNOWN_SYMBOL;
+            return push(shardOf(symbol), symbol, fill) ? SubmitStatus::QUEUED : SubmitStatus::QUEUE_FULL;
+        }
+
+        // Shard thread side
+        void run(size_t index);
+        void handle(size_t index, const ShardRequest& request);
+        void publishDepthOf(size_t index, SymbolId local);
+        template <typename F>
+        void publish(Shard& shard, F&& fill);
+};
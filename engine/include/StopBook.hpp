@@ -0,0 +1,150 @@
+#pragma once
+
+#include <map>
+#include <functional>
+#include "Order.hpp"
+#include "ObjectPool.hpp"
+#include "OrderIdMap.hpp"
+
+// Pending STOP / STOP_LIMIT orders of one book, kept out of the visible book
+// and sorted by trigger price. Buy stops fire once the last trade is at or
+// above their stop price, sell stops once it is at or below, so the next
+// order to fire is always at one end of its side's tree: releasing k orders
+// costs O(k log n), never a scan of everything pending. Orders with the same
+// stop price fire in arrival order. Tree nodes come from a preallocated pool.
+// Each owner's stops are also chained into a list, so an owner's mass cancel
+// walks only that owner's stops.
+class StopBook {
+public:
+    explicit StopBook(size_t capacity)
+        : pool(sizeof(Value) + 4 * sizeof(void*), capacity),
+          buys(std::less<Price>(), PoolAllocator<Value>(&pool)),
+          sells(std::less<Price>(), PoolAllocator<Value>(&pool)),
+          index(capacity),
+          ownerHeads(capacity) {}
+
+    bool empty() const { return index.size() == 0; }
+    size_t size() const { return index.size(); }
+    bool contains(uint64_t orderId) const { return index.contains(orderId); }
+
+    // The pending order with this id, or nullptr
+    const Order* find(uint64_t orderId) const {
+        const Map::iterator* handle = index.find(orderId);
+        return handle ? &(*handle)->second.order : nullptr;
+    }
+
+    // False if the pool is exhausted
+    bool add(const Order& order) {
+        if (pool.available() == 0) return false;
+        Map& side = order.side == Side::BUY ? buys : sells;
+        // Inserting at the upper bound keeps equal stop prices in arrival order
+        auto it = side.emplace_hint(side.upper_bound(order.stopPrice), order.stopPrice, Entry{order});
+        index.insert(order.orderId, it);
+        linkOwner(&it->second);
+        return true;
+    }
+
+    bool cancel(uint64_t orderId) {
+        Map::iterator* handle = index.find(orderId);
+        if (!handle) return false;
+        erase(*handle);
+        return true;
+    }
+
+    // Drop every pending stop for which pred(order) holds; returns how many
+    template <typename Pred>
+    size_t cancelWhere(Pred&& pred) {
+        size_t removed = 0;
+        for (Map* side : {&buys, &sells}) {
+            for (auto it = side->begin(); it != side->end();) {
+                if (pred(it->second.order)) {
+                    erase(it++);
+                    ++removed;
+                } else {
+                    ++it;
+                }
+            }
+        }
+        return removed;
+    }
+
+    // Drop the pending stops of `ownerId` (not 0) for which pred(order) holds;
+    // walks that owner's stops only. Returns how many.
+    template <typename Pred>
+    size_t cancelOwner(uint32_t ownerId, Pred&& pred) {
+        size_t removed = 0;
+        Entry** head = ownerHeads.find(ownerId);
+        for (Entry* entry = head ? *head : nullptr; entry;) {
+            Entry* next = entry->ownerNext;
+            if (pred(entry->order)) {
+                erase(*index.find(entry->order.orderId));
+                ++removed;
+            }
+            entry = next;
+        }
+        return removed;
+    }
+
+    // Remove and return the next order triggered by a trade at `lastPrice`.
+    // False if nothing is triggered.
+    bool popTriggered(Price lastPrice, Order& out) {
+        Map::iterator it;
+        if (!buys.empty() && buys.begin()->first <= lastPrice) {
+            it = buys.begin();
+        } else if (!sells.empty() && sells.rbegin()->first >= lastPrice) {
+            it = sells.lower_bound(sells.rbegin()->first);
+        } else {
+            return false;
+        }
+        out = it->second.order;
+        erase(it);
+        return true;
+    }
+
+private:
+    // Tree nodes never move, so entries can link to each other directly
+    struct Entry {
+        Order order;
+        Entry* ownerPrev = nullptr;
+        Entry* ownerNext = nullptr;
+    };
+    using Value = std::pair<const Price, Entry>;
+    using Map = std::multimap<Price, Entry, std::less<Price>, PoolAllocator<Value>>;
+
+    void erase(Map::iterator it) {
+        unlinkOwner(&it->second);
+        index.erase(it->second.order.orderId);
+        (it->second.order.side == Side::BUY ? buys : sells).erase(it);
+    }
+
+    void linkOwner(Entry* entry) {
+        uint32_t owner = entry->order.ownerId;
+        if (owner == 0) return;
+        if (Entry** head = ownerHeads.find(owner)) {
+            entry->ownerNext = *head;
+            (*head)->ownerPrev = entry;
+            *head = entry;
+        } else {
+            ownerHeads.insert(owner, entry);
+        }
+    }
+
+    void unlinkOwner(Entry* entry) {
+        uint32_t owner = entry->order.ownerId;
+        if (owner == 0) return;
+        if (entry->ownerPrev) {
+            entry->ownerPrev->ownerNext = entry->ownerNext;
+        } else if (entry->ownerNext) {
+            *ownerHeads.find(owner) = entry->ownerNext;
+        } else {
+            ownerHeads.erase(owner);
+        }
+        if (entry->ownerNext) entry->ownerNext->ownerPrev = entry->ownerPrev;
+    }
+
+    SlabPool pool;      // declared first: outlives the trees that use it
+    Map buys;
+    Map sells;
+    OrderIdMap<Map::iterator> index;
+    OrderIdMap<Entry*> ownerHeads;  // ownerId -> most recent stop of that owner
+};
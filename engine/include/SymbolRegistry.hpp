@@ -0,0 +1,26 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "Order.hpp"
+
+// Interns symbol names to dense ids (0, 1, 2, ...) so the engine can index
+// per-symbol state by id and never touch strings on the per-order path.
+// Ids are never reused.
+class SymbolRegistry {
+public:
+    // Existing id for `name`, or the next free one
+    SymbolId intern(const std::string& name);
+
+    // INVALID_SYMBOL if `name` was never interned
+    SymbolId find(const std::string& name) const;
+
+    const std::string& name(SymbolId id) const { return names[id]; }
+    bool contains(SymbolId id) const { return id < names.size(); }
+    size_t size() const { return names.size(); }
+
+private:
+    std::unordered_map<std::string, SymbolId> ids;
+    std::vector<std::string> names;
+};
@@ -0,0 +1,182 @@
+#pragma once
+
+#include <array>
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include "Order.hpp"
+#include "ObjectPool.hpp"
+
+// Hierarchical timing wheel over an integer tick clock. Level k has 256 slots
+// of 256^k ticks each; a timer sits in the lowest level whose slot span still
+// separates its deadline from the current tick, so four levels cover 2^32
+// ticks (deadlines further out are parked in the top level and re-filed when
+// it cascades). Timers are intrusive nodes in per-slot doubly linked lists:
+// schedule and cancel are O(1), and advancing touches only the slots the
+// clock passes plus, every 256^k ticks, one slot of level k being cascaded
+// down; stretches where the lower levels are empty are skipped in one step.
+// Timer nodes come from a preallocated pool.
+template <typename T>
+class TimerWheel {
+public:
+    struct Timer {
+        uint64_t deadline;
+        T payload;
+        Timer* prev = nullptr;
+        Timer* next = nullptr;
+        unsigned level = 0;
+        unsigned slot = 0;
+    };
+
+    // `now` is the current tick; `capacity` the maximum number of live timers
+    TimerWheel(uint64_t now, size_t capacity) : current(now), pool(capacity) {
+        for (auto& level : slots) level.fill(nullptr);
+    }
+
+    ~TimerWheel() {
+        for (auto& level : slots) {
+            for (Timer*& head : level) {
+                while (Timer* t = head) {
+                    head = t->next;
+                    pool.destroy(t);
+                }
+            }
+        }
+    }
+
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+    uint64_t now() const { return current; }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    // Fire `payload` once the clock reaches `deadline`; a deadline that has
+    // already passed fires on the next tick. nullptr if the pool is exhausted.
+    Timer* schedule(uint64_t deadline, const T& payload) {
+        Timer* t = pool.create(Timer{deadline, payload});
+        if (!t) return nullptr;
+        file(t, current + 1);
+        ++count;
+        return t;
+    }
+
+    // Drop a pending timer. The handle must not have fired yet.
+    void cancel(Timer* t) {
+        unlink(t);
+        pool.destroy(t);
+        --count;
+    }
+
+    // Move the clock to `now`, calling onExpire(payload) for every timer that
+    // comes due, one tick at a time. A fired timer is released before its
+    // callback runs, so the callback may schedule or cancel other timers.
+    template <typename F>
+    void advance(uint64_t now, F&& onExpire) {
+        while (current < now) {
+            if (count == 0) {
+                current = now;
+                return;
+            }
+
+            // With levels below k empty nothing can fire before the next
+            // level-k slot boundary, so jump straight to it
+            unsigned k = 0;
+            while (k < LEVELS - 1 && levelCount[k] == 0) ++k;
+            if (k > 0) {
+                uint64_t boundary = ((current >> (BITS * k)) + 1) << (BITS * k);
+                current = std::max(current, std::min(now, boundary) - 1);
+            }
+            ++current;
+
+            // Crossing a slot boundary of level k re-files that level's slot
+            for (unsigned k = 1; k < LEVELS && index(current, k - 1) == 0; ++k)
+                cascade(k, index(current, k));
+
+            Timer*& head = slots[0][index(current, 0)];
+            while (Timer* t = head) {
+                head = t->next;
+                if (head) head->prev = nullptr;
+                --levelCount[0];
+                T payload = t->payload;
+                pool.destroy(t);
+                --count;
+                onExpire(payload);
+            }
+        }
+    }
+
+private:
+    static constexpr unsigned BITS = 8;
+    static constexpr unsigned LEVELS = 4;
+    static constexpr size_t SLOTS = size_t(1) << BITS;
+
+    std::array<std::array<Timer*, SLOTS>, LEVELS> slots;
+    uint64_t current;
+    size_t count = 0;
+    std::array<size_t, LEVELS> levelCount{};
+    ObjectPool<Timer> pool;
+
+    static unsigned index(uint64_t tick, unsigned level) {
+        return unsigned(tick >> (BITS * level)) & unsigned(SLOTS - 1);
+    }
+
+    // Put `t` in the slot its deadline (but no earlier than `earliest`) maps to
+    void file(Timer* t, uint64_t earliest) {
+        uint64_t due = t->deadline > earliest ? t->deadline : earliest;
+
+        // Lowest level where the deadline shares every higher digit with now
+        unsigned level = 0;
+        while (level < LEVELS - 1 && (due >> (BITS * (level + 1))) != (current >> (BITS * (level + 1))))
+            ++level;
+
+        // Too far out for the top level to tell apart: park in the slot just
+        // behind the current one, which cascades last, and re-file from there
+        const uint64_t horizon = uint64_t(SLOTS - 1) << (BITS * (LEVELS - 1));
+        if (due - current >= horizon) due = current + horizon;
+
+        t->level = level;
+        t->slot = index(due, level);
+        Timer*& head = slots[level][t->slot];
+        t->prev = nullptr;
+        t->next = head;
+        if (head) head->prev = t;
+        head = t;
+        ++levelCount[level];
+    }
+
+    void unlink(Timer* t) {
+        if (t->prev) t->prev->next = t->next;
+        else slots[t->level][t->slot] = t->next;
+        if (t->next) t->next->prev = t->prev;
+        --levelCount[t->level];
+    }
+
+    void cascade(unsigned level, unsigned slot) {
+        Timer* t = slots[level][slot];
+        slots[level][slot] = nullptr;
+        while (t) {
+            Timer* next = t->next;
+            --levelCount[level];
+            // Deadlines in the slot being entered fire on this very tick
+            file(t, current);
+            t = next;
+        }
+    }
+};
+
+// What an expiry timer stands for: one resting GTD order
+struct OrderExpiry {
+    SymbolId symbolId;
+    uint64_t orderId;
+};
+
+using ExpiryWheel = TimerWheel<OrderExpiry>;
+
+// One expiry wheel tick, in the nanoseconds of Order::timestamp
+constexpr uint64_t EXPIRY_TICK_NS = 1'000'000;
+
+// First wheel tick at or after an order's expireTime
+inline uint64_t expiryTick(uint64_t expireTime) {
+    return (expireTime + EXPIRY_TICK_NS - 1) / EXPIRY_TICK_NS;
+}
@@ -0,0 +1,155 @@
+#include "ClientMessage.hpp"
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <cstring>
+
+// Strip leading and trailing blanks / control characters
+static std::string trim(const std::string& s) {
+    size_t start = 0;
+    while (start < s.size() && (unsigned char)s[start] <= 32) start++;
+
+    size_t end = s.size();
+    while (end > start && (unsigned char)s[end - 1] <= 32) end--;
+    return s.substr(start, end - start);
+}
+
+static bool copySymbol(const std::string& symbol, ClientMessage& out) {
+    if (symbol.size() > CLIENT_SYMBOL_MAX) {
+        std::cerr << "Symbol longer than " << CLIENT_SYMBOL_MAX << " characters\n";
+        return false;
+    }
+    std::memcpy(out.symbol, symbol.c_str(), symbol.size() + 1);
+    return true;
+}
+
+// NEW,<orderId>,<SYMBOL>,<side>,<type>,<price>,<qty>[,options...]
+static bool decodeNew(const std::vector<std::string>& parts, ClientMessage& o) {
+    if (parts.size() < 7) {
+        std::cerr << "NEW command requires 6 args plus options. Type HELP.\n";
+        return false;
+    }
+    try { o.orderId = std::stoull(parts[1]); } catch(...) { std::cerr << "Invalid orderId\n"; return false; }
+    if (!copySymbol(parts[2], o)) return false;
+    const std::string& sideStr = parts[3];
+    const std::string& typeStr = parts[4];
+    try { o.price = std::stod(parts[5]); o.quantity = static_cast<uint32_t>(std::stoul(parts[6])); } catch(...) { std::cerr << "Invalid price/qty\n"; return false; }
+
+    if (sideStr == "BUY") o.side = Side::BUY;
+    else if (sideStr == "SELL") o.side = Side::SELL;
+    else { std::cerr << "Invalid side\n"; return false; }
+
+    if (typeStr == "LIMIT") o.type = OrderType::LIMIT;
+    else if (typeStr == "MARKET") o.type = OrderType::MARKET;
+    else if (typeStr == "STOP") o.type = OrderType::STOP;
+    else if (typeStr == "STOP_LIMIT") o.type = OrderType::STOP_LIMIT;
+    else { std::cerr << "Invalid type\n"; return false; }
+
+    // Trailing options, in any order
+    o.timeInForce = TimeInForce::GTC;
+    o.lifetimeMs = 0;
+    o.displayQty = 0;
+    o.stopPrice = 0.0;
+    o.ownerId = 0;
+    o.stp = SelfTradePrevention::NONE;
+    bool hasStop = false;
+    for (size_t i = 7; i < parts.size(); ++i) {
+        const std::string& opt = parts[i];
+        if (opt == "GTC") o.timeInForce = TimeInForce::GTC;
+        else if (opt == "IOC") o.timeInForce = TimeInForce::IOC;
+        else if (opt == "FOK") o.timeInForce = TimeInForce::FOK;
+        else if (opt.rfind("GTD=", 0) == 0) {
+            try { o.lifetimeMs = std::stoull(opt.substr(4)); o.timeInForce = TimeInForce::GTD; } catch(...) { std::cerr << "Invalid GTD\n"; return false; }
+        }
+        else if (opt.rfind("PEAK=", 0) == 0) {
+            try { o.displayQty = static_cast<uint32_t>(std::stoul(opt.substr(5))); } catch(...) { std::cerr << "Invalid PEAK\n"; return false; }
+        }
+        else if (opt.rfind("STOP=", 0) == 0) {
+            try { o.stopPrice = std::stod(opt.substr(5)); hasStop = true; } catch(...) { std::cerr << "Invalid STOP\n"; return false; }
+        }
+        else if (opt.rfind("OWNER=", 0) == 0) {
+            try { o.ownerId = static_cast<uint32_t>(std::stoul(opt.substr(6))); } catch(...) { std::cerr << "Invalid OWNER\n"; return false; }
+            if (o.ownerId == NO_SELF_MATCH) { std::cerr << "Invalid OWNER\n"; return false; }
+        }
+        else if (opt == "STP=NEWEST") o.stp = SelfTradePrevention::CANCEL_NEWEST;
+        else if (opt == "STP=OLDEST") o.stp = SelfTradePrevention::CANCEL_OLDEST;
+        else if (opt == "STP=BOTH") o.stp = SelfTradePrevention::CANCEL_BOTH;
+        else if (opt == "STP=DECREMENT") o.stp = SelfTradePrevention::DECREMENT;
+        else { std::cerr << "Invalid option " << opt << "\n"; return false; }
+    }
+
+    bool isStop = o.type == OrderType::STOP || o.type == OrderType::STOP_LIMIT;
+    if (isStop != hasStop) {
+        std::cerr << (isStop ? "STOP orders need STOP=<price>\n" : "STOP= only applies to STOP/STOP_LIMIT\n");
+        return false;
+    }
+    bool hasLimit = o.type == OrderType::LIMIT || o.type == OrderType::STOP_LIMIT;
+    if (!hasLimit) o.price = 0.0;
+    return true;
+}
+
+// CANCEL,<SYMBOL>,<orderId> or CANCEL,<orderId>
+static bool decodeCancel(const std::vector<std::string>& parts, ClientMessage& o) {
+    if (parts.size() != 3 && parts.size() != 2) {
+        std::cerr << "CANCEL requires orderId and optional symbol (CANCEL,<symbol>,<orderId> or CANCEL,<orderId>)\n";
+        return false;
+    }
+    o.symbol[0] = '\0';
+    if (parts.size() == 3 && !copySymbol(parts[1], o)) return false;
+    try { o.orderId = std::stoull(parts.back()); } catch(...) { std::cerr << "Invalid orderId\n"; return false; }
+    return true;
+}
+
+// MODIFY,<SYMBOL>,<orderId>,<newPrice>,<newQty> or MODIFY,<orderId>,<newPrice>,<newQty>
+static bool decodeModify(const std::vector<std::string>& parts, ClientMessage& o) {
+    if (parts.size() != 5 && parts.size() != 4) {
+        std::cerr << "MODIFY requires orderId, price, qty and optional symbol (MODIFY,[<SYMBOL>,]<orderId>,<newPrice>,<newQty>)\n";
+        return false;
+    }
+    o.symbol[0] = '\0';
+    size_t first = parts.size() - 3;
+    if (parts.size() == 5 && !copySymbol(parts[1], o)) return false;
+    try {
+        o.orderId = std::stoull(parts[first]);
+        o.price = std::stod(parts[first + 1]);
+        o.quantity = static_cast<uint32_t>(std::stoul(parts[first + 2]));
+    } catch (...) { std::cerr << "Invalid orderId/price/qty\n"; return false; }
+    return true;
+}
+
+bool decodeClientMessage(const std::string& line, ClientMessage& out) {
+    // ignore comments
+    std::string l = line.substr(0, line.find('#'));
+    l = trim(l);
+    if (l.empty()) return false;
+
+    std::string cmd = trim(l.substr(0, l.find(',')));
+    if (cmd == "NEW" || cmd == "CANCEL" || cmd == "MODIFY") {
+        // CSV parse
+        std::stringstream ss(l);
+        std::string token;
+        std::vector<std::string> parts;
+        while (std::getline(ss, token, ',')) {
+            parts.push_back(trim(token));
+        }
+
+        if (cmd == "NEW") {
+            out.kind = ClientMessage::Kind::NEW;
+            return decodeNew(parts, out);
+        }
+        if (cmd == "CANCEL") {
+            out.kind = ClientMessage::Kind::CANCEL;
+            return decodeCancel(parts, out);
+        }
+        out.kind = ClientMessage::Kind::MODIFY;
+        return decodeModify(parts, out);
+    }
+
+    if (l.size() > CLIENT_TEXT_MAX) {
+        std::cerr << "Command longer than " << CLIENT_TEXT_MAX << " characters\n";
+        return false;
+    }
+    out.kind = ClientMessage::Kind::TEXT;
+    std::memcpy(out.text, l.c_str(), l.size() + 1);
+    return true;
+}
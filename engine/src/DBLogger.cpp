@@ -35,24 +35,30 @@ void DBLogger::exec(const std::string& sql) {
     }
 }
 
-void DBLogger::logOrder(const Order& o) {
+void DBLogger::logOrder(const Order& o, const std::string& symbol, double tickSize) {
     std::string side = (o.side == Side::BUY ? "BUY" : "SELL");
-    std::string type = (o.type == OrderType::LIMIT ? "LIMIT" : "MARKET");
+    std::string type;
+    switch (o.type) {
+        case OrderType::LIMIT:      type = "LIMIT"; break;
+        case OrderType::MARKET:     type = "MARKET"; break;
+        case OrderType::STOP:       type = "STOP"; break;
+        case OrderType::STOP_LIMIT: type = "STOP_LIMIT"; break;
+    }
 
     std::string sql =
         "INSERT INTO Orders VALUES (" +
-        std::to_string(o.orderId) + ", '" + o.symbol + "', '" + side +
-        "', '" + type + "', " + std::to_string(o.price) + ", " +
+        std::to_string(o.orderId) + ", '" + symbol + "', '" + side +
+        "', '" + type + "', " + std::to_string(fromTicks(o.price, tickSize)) + ", " +
         std::to_string(o.quantity) + ", " + std::to_string(o.timestamp) + ");";
 
     exec(sql);
 }
 
-void DBLogger::logTrade(const Trade& t, const std::string& symbol) {
+void DBLogger::logTrade(const Trade& t, const std::string& symbol, double tickSize) {
     std::string sql =
         "INSERT INTO Trades VALUES (" +
         std::to_string(t.tradeId) + ", '" + symbol + "', " +
-        std::to_string(t.price) + ", " + std::to_string(t.quantity) + ", " +
+        std::to_string(fromTicks(t.price, tickSize)) + ", " + std::to_string(t.quantity) + ", " +
         std::to_string(t.buyOrderId) + ", " +
         std::to_string(t.sellOrderId) + ", " +
         std::to_string(t.timestamp) + ");";
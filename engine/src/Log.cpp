@@ -0,0 +1,106 @@
+#include "Log.hpp"
+#include "RingBuffer.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+
+namespace {
+
+struct Record {
+    Log::Level level;
+    char text[248];
+};
+
+constexpr size_t LOG_RING_SIZE = 4096;
+
+const char* levelName(Log::Level level) {
+    switch (level) {
+        case Log::Level::DEBUG: return "DEBUG";
+        case Log::Level::INFO:  return "INFO";
+        case Log::Level::WARN:  return "WARN";
+        case Log::Level::ERROR: return "ERROR";
+    }
+    return "?";
+}
+
+class Logger {
+public:
+    ~Logger() { stop(); }
+
+    void write(Log::Level level, const char* fmt, va_list args) {
+        if (!running.load(std::memory_order_acquire)) start();
+
+        bool pushed = ring.tryPushWith([&](Record& r) {
+            r.level = level;
+            std::vsnprintf(r.text, sizeof(r.text), fmt, args);
+        });
+        if (!pushed) dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void start() {
+        std::lock_guard<std::mutex> g(lifecycle);
+        if (running.load(std::memory_order_relaxed)) return;
+        running.store(true, std::memory_order_release);
+        drainer = std::thread([this]() { drainLoop(); });
+    }
+
+    void stop() {
+        std::lock_guard<std::mutex> g(lifecycle);
+        if (!running.load(std::memory_order_relaxed)) return;
+        running.store(false, std::memory_order_release);
+        if (drainer.joinable()) drainer.join();
+    }
+
+private:
+    MpscRing<Record, LOG_RING_SIZE> ring;
+    std::atomic<bool> running{false};
+    std::atomic<uint64_t> dropped{0};
+    std::thread drainer;
+    std::mutex lifecycle;
+
+    // Returns true if anything was written
+    bool drainOnce() {
+        bool any = false;
+        Record r;
+        while (ring.tryPop(r)) {
+            std::fprintf(stderr, "[%s] %s\n", levelName(r.level), r.text);
+            any = true;
+        }
+        uint64_t lost = dropped.exchange(0, std::memory_order_relaxed);
+        if (lost) std::fprintf(stderr, "[WARN] log ring full, %" PRIu64 " messages dropped\n", lost);
+        return any;
+    }
+
+    void drainLoop() {
+        while (running.load(std::memory_order_acquire)) {
+            if (!drainOnce()) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        drainOnce();
+        std::fflush(stderr);
+    }
+};
+
+Logger& logger() {
+    static Logger instance;
+    return instance;
+}
+
+} // namespace
+
+namespace Log {
+
+void write(Level level, const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    logger().write(level, fmt, args);
+    va_end(args);
+}
+
+void stop() {
+    logger().stop();
+}
+
+} // namespace Log
@@ -1,15 +1,15 @@
 #include "MarketDataServer.hpp"
+#include "Log.hpp"
+#include "RingBuffer.hpp"
 #include <boost/asio.hpp>
 #include <boost/beast.hpp>
 #include <boost/beast/websocket.hpp>
 #include <thread>
 #include <mutex>
 #include <set>
-#include <queue>
 #include <memory>
 #include <iostream>
 #include <atomic>
-#include <condition_variable>
 
 namespace asio  = boost::asio;
 namespace beast = boost::beast;
@@ -23,10 +23,14 @@ using ws_ptr = std::shared_ptr<ws_stream_t>;
 static std::set<ws_ptr> g_sessions;
 static std::mutex g_sessions_mtx;
 
-// client→server queue
-static std::queue<std::string> g_client_queue;
-static std::mutex g_client_queue_mtx;
-static std::condition_variable g_client_queue_cv;
+// client→server queue: every session thread pushes, the matching loop pops.
+// When it is full the message is refused and its client told so. One MPSC
+// ring rather than an SPSC ring per session: sessions come and go on their
+// own threads, and a single ring keeps one arrival order across clients
+// without a ring registry the matching loop would have to scan.
+static constexpr size_t CLIENT_QUEUE_SIZE = 1024;
+static MpscRing<ClientMessage, CLIENT_QUEUE_SIZE> g_client_queue;
+static std::atomic<uint64_t> g_client_rejects{0};
 
 // io_context and listener thread
 static std::unique_ptr<asio::io_context> g_ioc;
@@ -88,12 +92,17 @@ namespace MarketDataServerAPI {
                             // extract string
                             std::string msg = beast::buffers_to_string(buffer.data());
                             buffer.consume(buffer.size());
-                            // push into queue
-                            {
-                                std::lock_guard<std::mutex> ql(g_client_queue_mtx);
-                                g_client_queue.push(msg);
+                            // decode here, off the matching thread, then push into queue
+                            ClientMessage decoded;
+                            if (!decodeClientMessage(msg, decoded)) continue;
+                            if (!g_client_queue.tryPush(decoded)) {
+                                ENGINE_LOG_WARN("Client queue full: message refused (%" PRIu64 " so far)",
+                                                ++g_client_rejects);
+                                static const std::string busy = "{\"type\":\"reject\",\"reason\":\"engine busy\"}\n";
+                                std::lock_guard<std::mutex> g(g_sessions_mtx);
+                                session->text(true);
+                                session->write(asio::buffer(busy), ec);
                             }
-                            g_client_queue_cv.notify_one();
                         }
                     }).detach();
                 }
@@ -104,10 +113,12 @@ namespace MarketDataServerAPI {
     }
 
     void broadcast(const std::string& msg) {
-        // echo to stderr for logs
-        std::cerr << msg << std::endl;
-
         std::lock_guard<std::mutex> g(g_sessions_mtx);
+        // echo to stderr: tools/marketdata_server.js forwards these lines as
+        // market data, so they go out raw and whole whatever the log level
+        std::cerr << msg;
+        if (msg.empty() || msg.back() != '\n') std::cerr << '\n';
+        std::cerr.flush();
         for (auto it = g_sessions.begin(); it != g_sessions.end();) {
             auto s = *it;
             if (!s) { it = g_sessions.erase(it); continue; }
@@ -122,12 +133,8 @@ namespace MarketDataServerAPI {
         }
     }
 
-    bool try_pop_client_message(std::string &out) {
-        std::lock_guard<std::mutex> g(g_client_queue_mtx);
-        if (g_client_queue.empty()) return false;
-        out = std::move(g_client_queue.front());
-        g_client_queue.pop();
-        return true;
+    bool try_pop_client_message(ClientMessage &out) {
+        return g_client_queue.tryPop(out);
     }
 
     void stop() {
@@ -145,7 +152,7 @@ namespace MarketDataServerAPI {
         std::lock_guard<std::mutex> g(g_sessions_mtx);
         g_sessions.clear();
         // clear queue
-        std::lock_guard<std::mutex> q(g_client_queue_mtx);
-        while (!g_client_queue.empty()) g_client_queue.pop();
+        ClientMessage dropped;
+        while (g_client_queue.tryPop(dropped)) {}
     }
 }
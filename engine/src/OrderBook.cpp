@@ -1,226 +1,817 @@
 #include "OrderBook.hpp"
+#include "Log.hpp"
 #include <iostream>
-#include <limits>
 #include <algorithm>
+#include <numeric>
+
+template <template <Side> class Levels, typename Allocation>
+BasicOrderBook<Levels, Allocation>::BasicOrderBook(double tickSize, const BookCapacity& capacity)
+    : tickSize(tickSize),
+      capacity(capacity),
+      bids(capacity.levels),
+      asks(capacity.levels),
+      nodePool(capacity.orders),
+      orders(capacity.orders),
+      ownerHeads(capacity.orders),
+      stops(capacity.stops) {}
+
+template <template <Side> class Levels, typename Allocation>
+BasicOrderBook<Levels, Allocation>::~BasicOrderBook() {
+    orders.forEach([&](uint64_t orderId, OrderNode* node) {
+        if (index) index->erase(orderId);
+        if (node->expiry) expiries->cancel(node->expiry);
+        nodePool.destroy(node);
+    });
+    if (index) stops.cancelWhere([&](const Order& o) { return index->erase(o.orderId); });
+}
 
-OrderBook::OrderBook() {}
+template <template <Side> class Levels, typename Allocation>
+void BasicOrderBook<Levels, Allocation>::addOrder(const Order& order, TradeSink onTrade) {
+    lastStatus = OrderStatus::ACCEPTED;
 
-std::vector<Trade> OrderBook::addOrder(const Order& order) {
-    if (order.type == OrderType::MARKET) {
-        if (order.side == Side::BUY)
-            return matchMarketBuy(order);
-        else
-            return matchMarketSell(order);
+    // The id index needs unique ids among resting orders
+    if (orders.contains(order.orderId) || stops.contains(order.orderId) ||
+        (index && index->contains(order.orderId))) {
+        ENGINE_LOG_WARN("Rejected order %" PRIu64 ": duplicate orderId", order.orderId);
+        lastStatus = OrderStatus::DUPLICATE_ID;
+        return;
+    }
+
+    if (order.type == OrderType::STOP || order.type == OrderType::STOP_LIMIT) {
+        if (index && !index->insert(order.orderId, OrderLocation{order.symbolId, nullptr})) {
+            ENGINE_LOG_WARN("Rejected stop order %" PRIu64 ": order index full", order.orderId);
+            lastStatus = OrderStatus::POOL_EXHAUSTED;
+            return;
+        }
+        if (!stops.add(order)) {
+            if (index) index->erase(order.orderId);
+            ENGINE_LOG_WARN("Rejected stop order %" PRIu64 ": stop pool exhausted", order.orderId);
+            lastStatus = OrderStatus::POOL_EXHAUSTED;
+            return;
+        }
+        ENGINE_LOG_DEBUG("Added stop order %" PRIu64 ": trigger @ %" PRId64, order.orderId, order.stopPrice);
+        // The last trade may already be through the stop
+        releaseStops(onTrade);
+        return;
+    }
+
+    if (inAuction) {
+        bool rests = order.type == OrderType::LIMIT &&
+                     order.timeInForce != TimeInForce::IOC && order.timeInForce != TimeInForce::FOK;
+        if (!rests) {
+            ENGINE_LOG_INFO("Rejected order %" PRIu64 ": book is in auction", order.orderId);
+            lastStatus = OrderStatus::AUCTION_REJECTED;
+            return;
+        }
+        lastStatus = insertLimitOrder(order);
+        return;
     }
 
     if (order.side == Side::BUY)
-        return matchLimitBuy(order);
+        route<Side::BUY>(order, onTrade);
     else
-        return matchLimitSell(order);
+        route<Side::SELL>(order, onTrade);
+
+    if (!stops.empty()) releaseStops(onTrade);
 }
 
-std::vector<Trade> OrderBook::matchMarketBuy(Order order) {
-    order.price = std::numeric_limits<double>::infinity(); // can match all asks
-    auto trades = matchLimitBuy(order);
-    // Market orders NEVER rest
-    return trades;
+template <template <Side> class Levels, typename Allocation>
+void BasicOrderBook<Levels, Allocation>::releaseStops(TradeSink onTrade) {
+    if (!hasLastTrade || inAuction) return;
+
+    // Callers see the verdict on their own order, not on the stops it fired
+    OrderStatus status = lastStatus;
+    Order triggered;
+    while (stops.popTriggered(lastTradePrice, triggered)) {
+        if (index) index->erase(triggered.orderId);
+        triggered.type = triggered.type == OrderType::STOP ? OrderType::MARKET : OrderType::LIMIT;
+        ENGINE_LOG_DEBUG("Stop order %" PRIu64 " triggered: last trade %" PRId64 ", stop %" PRId64,
+                         triggered.orderId, lastTradePrice, triggered.stopPrice);
+        if (triggered.side == Side::BUY)
+            route<Side::BUY>(triggered, onTrade);
+        else
+            route<Side::SELL>(triggered, onTrade);
+    }
+    lastStatus = status;
 }
 
-std::vector<Trade> OrderBook::matchMarketSell(Order order) {
-    order.price = 0.0; // can match all bids
-    auto trades = matchLimitSell(order);
-    // Market orders NEVER rest
+template <template <Side> class Levels, typename Allocation>
+template <Side S>
+void BasicOrderBook<Levels, Allocation>::route(const Order& order, TradeSink onTrade) {
+    bool fok = order.timeInForce == TimeInForce::FOK;
+
+    if (order.type == OrderType::MARKET) {
+        // Market orders NEVER rest
+        if (fok && !canFill<S, MarketPolicy>(order)) {
+            lastStatus = OrderStatus::NOT_FILLABLE;
+        } else {
+            match<S, MarketPolicy>(order, onTrade);
+        }
+    } else if (fok) {
+        if (!canFill<S, LimitPolicy>(order)) lastStatus = OrderStatus::NOT_FILLABLE;
+        else match<S, IocPolicy>(order, onTrade);
+    } else if (order.timeInForce == TimeInForce::IOC) {
+        match<S, IocPolicy>(order, onTrade);
+    } else {
+        match<S, LimitPolicy>(order, onTrade);
+    }
+
+    if (lastStatus == OrderStatus::NOT_FILLABLE)
+        ENGINE_LOG_INFO("FOK order %" PRIu64 " killed: cannot fill %" PRIu32, order.orderId, order.quantity);
+}
+
+template <template <Side> class Levels, typename Allocation>
+template <Side S, typename Policy>
+bool BasicOrderBook<Levels, Allocation>::canFill(const Order& order) const {
+    constexpr Side restingSide = S == Side::BUY ? Side::SELL : Side::BUY;
+    auto better = [](Price a, Price b) { return S == Side::BUY ? a < b : a > b; };
+
+    // The owner's crossing size, and the first price where matching meets it
+    uint64_t own = 0;
+    bool hasOwn = false;
+    Price firstOwn = 0;
+    if (order.stp != SelfTradePrevention::NONE && order.ownerId != 0) {
+        const OrderNode* const* head = ownerHeads.find(order.ownerId);
+        for (const OrderNode* node = head ? *head : nullptr; node; node = node->ownerNext) {
+            Price price = node->order.price;
+            if (node->order.side != restingSide || !Policy::template crosses<S>(order.price, price)) continue;
+            own += node->order.quantity + node->reserve;
+            if (!hasOwn || better(price, firstOwn)) firstOwn = price;
+            hasOwn = true;
+        }
+    }
+
+    // CANCEL_OLDEST removes the owner's orders and keeps matching past them;
+    // every other mode ends or shrinks the order at the first one, so the
+    // fill must come from strictly better levels
+    bool stopsAtOwn = hasOwn && order.stp != SelfTradePrevention::CANCEL_OLDEST;
+    uint64_t needed = order.quantity + (stopsAtOwn ? 0 : own);
+
+    uint64_t available = 0;
+    oppositeLevels<S>().forEach([&](Price price, const PriceLevel& level) {
+        if (!Policy::template crosses<S>(order.price, price)) return false;
+        if (stopsAtOwn && !better(price, firstOwn)) return false;
+        available += level.totalQty + level.hiddenQty;
+        return available < needed;
+    });
+    return available >= needed;
+}
+
+template <template <Side> class Levels, typename Allocation>
+void BasicOrderBook<Levels, Allocation>::addOrder(const Order& order, std::vector<Trade>& out) {
+    addOrder(order, [&out](const Trade& t) { out.push_back(t); });
+}
+
+template <template <Side> class Levels, typename Allocation>
+std::vector<Trade> BasicOrderBook<Levels, Allocation>::addOrder(const Order& order) {
+    std::vector<Trade> trades;
+    addOrder(order, trades);
     return trades;
 }
 
-void OrderBook::insertLimitOrder(const Order& order) {
-    if (order.side == Side::BUY) {
-        bids[order.price].push_back(order);
+template <template <Side> class Levels, typename Allocation>
+OrderStatus BasicOrderBook<Levels, Allocation>::insertLimitOrder(const Order& order) {
+    OrderNode* node = nodePool.create(order);
+    if (!node) {
+        ENGINE_LOG_WARN("Rejected LIMIT order %" PRIu64 ": order pool exhausted", order.orderId);
+        return OrderStatus::POOL_EXHAUSTED;
+    }
+    if (index && !index->insert(order.orderId, OrderLocation{order.symbolId, node})) {
+        nodePool.destroy(node);
+        ENGINE_LOG_WARN("Rejected LIMIT order %" PRIu64 ": order index full", order.orderId);
+        return OrderStatus::POOL_EXHAUSTED;
+    }
+    if (order.displayQty > 0 && order.displayQty < order.quantity) {
+        node->reserve = order.quantity - order.displayQty;
+        node->order.quantity = order.displayQty;
     } else {
-        asks[order.price].push_back(order);
+        // A peak at or above the size shows everything: not an iceberg
+        node->order.displayQty = 0;
     }
 
-    orderIdToPrice[order.orderId] = order.price;
+    if (order.timeInForce == TimeInForce::GTD && expiries) {
+        node->expiry = expiries->schedule(expiryTick(order.expireTime), OrderExpiry{order.symbolId, order.orderId});
+        if (!node->expiry) {
+            nodePool.destroy(node);
+            if (index) index->erase(order.orderId);
+            ENGINE_LOG_WARN("Rejected GTD order %" PRIu64 ": expiry timers exhausted", order.orderId);
+            return OrderStatus::TIMER_EXHAUSTED;
+        }
+    }
 
-    std::cout << "Added LIMIT order: "
-              << (order.side == Side::BUY ? "BUY " : "SELL ")
-              << order.quantity << " @ " << order.price << "\n";
+    PriceLevel* level = (order.side == Side::BUY) ? bids.at(order.price)
+                                                  : asks.at(order.price);
+    if (!level) {
+        if (node->expiry) expiries->cancel(node->expiry);
+        nodePool.destroy(node);
+        if (index) index->erase(order.orderId);
+        ENGINE_LOG_WARN("Rejected LIMIT order %" PRIu64 ": no price level available at %" PRId64,
+                        order.orderId, order.price);
+        return OrderStatus::LEVEL_UNAVAILABLE;
+    }
+    if (level->empty()) levelAdded(order.side, order.price);
+    level->pushBack(node);
+    markDepth(order.side);
+
+    orders.insert(order.orderId, node);
+    linkOwner(node);
+
+    ENGINE_LOG_DEBUG("Added LIMIT order %" PRIu64 ": %s %" PRIu32 " @ %" PRId64,
+                     order.orderId, order.side == Side::BUY ? "BUY" : "SELL",
+                     order.quantity, order.price);
+    return OrderStatus::ACCEPTED;
 }
 
-void OrderBook::cancelOrder(uint64_t orderId) {
-    auto it_lookup = orderIdToPrice.find(orderId);
-    if (it_lookup == orderIdToPrice.end()) {
-        std::cout << "Order not found\n";
+template <template <Side> class Levels, typename Allocation>
+void BasicOrderBook<Levels, Allocation>::cancelOrder(uint64_t orderId) {
+    OrderNode** handle = orders.find(orderId);
+    if (!handle) {
+        if (stops.cancel(orderId)) {
+            if (index) index->erase(orderId);
+            ENGINE_LOG_DEBUG("Cancelled stop order %" PRIu64, orderId);
+        } else ENGINE_LOG_INFO("Cancel: order %" PRIu64 " not found", orderId);
         return;
     }
 
-    double price = it_lookup->second;
+    removeResting(*handle);
+    ENGINE_LOG_DEBUG("Cancelled order %" PRIu64, orderId);
+}
 
-    auto eraseFrom = [&](auto& book) {
-        auto it = book.find(price);
-        if (it == book.end()) return false;
+template <template <Side> class Levels, typename Allocation>
+void BasicOrderBook<Levels, Allocation>::expireOrder(uint64_t orderId) {
+    OrderNode** handle = orders.find(orderId);
+    if (!handle) return;
+    // The wheel has already released the timer
+    (*handle)->expiry = nullptr;
+    removeResting(*handle);
+    ENGINE_LOG_DEBUG("Expired GTD order %" PRIu64, orderId);
+}
 
-        auto& dq = it->second;
+template <template <Side> class Levels, typename Allocation>
+void BasicOrderBook<Levels, Allocation>::removeResting(OrderNode* node) {
+    Price price = node->order.price;
+    PriceLevel* level = node->level;
 
-        for (auto iter = dq.begin(); iter != dq.end(); ++iter) {
-            if (iter->orderId == orderId) {
-                dq.erase(iter);
-                if (dq.empty()) book.erase(it);
-                return true;
-            }
-        }
-        return false;
+    level->unlink(node);
+    markDepth(node->order.side);
+    if (level->empty()) eraseLevel(node->order.side, price);
+
+    releaseNode(node);
+}
+
+template <template <Side> class Levels, typename Allocation>
+void BasicOrderBook<Levels, Allocation>::releaseNode(OrderNode* node) {
+    orders.erase(node->order.orderId);
+    if (index) index->erase(node->order.orderId);
+    unlinkOwner(node);
+    if (node->expiry) expiries->cancel(node->expiry);
+    nodePool.destroy(node);
+}
+
+template <template <Side> class Levels, typename Allocation>
+void BasicOrderBook<Levels, Allocation>::levelAdded(Side side, Price price) {
+    if (side == Side::BUY) {
+        if (top.hasBid && price <= top.bestBid) return;
+        top.hasBid = true;
+        top.bestBid = price;
+    } else {
+        if (top.hasAsk && price >= top.bestAsk) return;
+        top.hasAsk = true;
+        top.bestAsk = price;
+    }
+    changes |= BBO_CHANGED;
+}
+
+template <template <Side> class Levels, typename Allocation>
+void BasicOrderBook<Levels, Allocation>::levelRemoved(Side side, Price price) {
+    // Only losing the best level moves the top; the next one is the front
+    // both level containers keep at hand
+    if (side == Side::BUY) {
+        if (price != top.bestBid) return;
+        top.hasBid = !bids.empty();
+        top.bestBid = top.hasBid ? bids.bestPrice() : 0;
+    } else {
+        if (price != top.bestAsk) return;
+        top.hasAsk = !asks.empty();
+        top.bestAsk = top.hasAsk ? asks.bestPrice() : 0;
+    }
+    changes |= BBO_CHANGED;
+}
+
+template <template <Side> class Levels, typename Allocation>
+void BasicOrderBook<Levels, Allocation>::eraseLevel(Side side, Price price) {
+    if (side == Side::BUY) bids.erase(price);
+    else asks.erase(price);
+    levelRemoved(side, price);
+}
+
+template <template <Side> class Levels, typename Allocation>
+void BasicOrderBook<Levels, Allocation>::popBestLevel(Side side) {
+    Price price;
+    if (side == Side::BUY) {
+        price = bids.bestPrice();
+        bids.popBest();
+    } else {
+        price = asks.bestPrice();
+        asks.popBest();
+    }
+    levelRemoved(side, price);
+}
+
+template <template <Side> class Levels, typename Allocation>
+BookChanges BasicOrderBook<Levels, Allocation>::takeChanges() {
+    BookChanges taken = changes;
+    // A best price that moved and came back within one call is no change
+    if (top == reportedTop) taken &= ~BBO_CHANGED;
+    reportedTop = top;
+    changes = NO_CHANGE;
+    return taken;
+}
+
+template <template <Side> class Levels, typename Allocation>
+void BasicOrderBook<Levels, Allocation>::linkOwner(OrderNode* node) {
+    uint32_t owner = node->order.ownerId;
+    if (owner == 0) return;
+    if (OrderNode** head = ownerHeads.find(owner)) {
+        node->ownerNext = *head;
+        (*head)->ownerPrev = node;
+        *head = node;
+    } else {
+        ownerHeads.insert(owner, node);
+    }
+}
+
+template <template <Side> class Levels, typename Allocation>
+void BasicOrderBook<Levels, Allocation>::unlinkOwner(OrderNode* node) {
+    uint32_t owner = node->order.ownerId;
+    if (owner == 0) return;
+    if (node->ownerPrev) {
+        node->ownerPrev->ownerNext = node->ownerNext;
+    } else if (node->ownerNext) {
+        *ownerHeads.find(owner) = node->ownerNext;
+    } else {
+        ownerHeads.erase(owner);
+    }
+    if (node->ownerNext) node->ownerNext->ownerPrev = node->ownerPrev;
+    node->ownerPrev = node->ownerNext = nullptr;
+}
+
+template <template <Side> class Levels, typename Allocation>
+size_t BasicOrderBook<Levels, Allocation>::cancelAll(uint32_t ownerId, SideFilter sides) {
+    auto onSide = [sides](Side side) {
+        return sides == SideFilter::BOTH || (sides == SideFilter::BUY) == (side == Side::BUY);
     };
 
-    bool erased = eraseFrom(bids) || eraseFrom(asks);
+    size_t removed = 0;
+    auto drop = [&](OrderNode* node) {
+        removeResting(node);
+        ++removed;
+    };
 
-    if (erased) {
-        orderIdToPrice.erase(it_lookup);
-        std::cout << "Cancelled order " << orderId << "\n";
+    if (ownerId != 0) {
+        OrderNode** head = ownerHeads.find(ownerId);
+        for (OrderNode* node = head ? *head : nullptr; node;) {
+            OrderNode* next = node->ownerNext;
+            if (onSide(node->order.side)) drop(node);
+            node = next;
+        }
     } else {
-        std::cout << "Order not found in book (maybe filled) – cleaning lookup\n";
-        orderIdToPrice.erase(it_lookup);
+        if (onSide(Side::BUY))
+            while (!bids.empty()) drop(bids.best().front());
+        if (onSide(Side::SELL))
+            while (!asks.empty()) drop(asks.best().front());
     }
+
+    if (!stops.empty()) {
+        auto dropStop = [&](const Order& o) {
+            if (!onSide(o.side)) return false;
+            if (index) index->erase(o.orderId);
+            return true;
+        };
+        removed += ownerId != 0 ? stops.cancelOwner(ownerId, dropStop)
+                                : stops.cancelWhere(dropStop);
+    }
+
+    ENGINE_LOG_DEBUG("Mass cancel owner %" PRIu32 ": %zu orders", ownerId, removed);
+    return removed;
 }
 
-void OrderBook::printTopLevels() const {
+template <template <Side> class Levels, typename Allocation>
+void BasicOrderBook<Levels, Allocation>::modifyOrder(uint64_t orderId, Price newPrice, uint32_t newQty,
+                                         TradeSink onTrade) {
+    lastStatus = OrderStatus::ACCEPTED;
+
+    OrderNode** handle = orders.find(orderId);
+    if (!handle) {
+        ENGINE_LOG_INFO("Modify: order %" PRIu64 " not found", orderId);
+        lastStatus = OrderStatus::UNKNOWN_ORDER;
+        return;
+    }
+    if (newQty == 0) {
+        cancelOrder(orderId);
+        return;
+    }
+
+    OrderNode* node = *handle;
+    Order& order = node->order;
+    PriceLevel* level = node->level;
+
+    // Quantities are totals: an iceberg's reserve is cut before its peak
+    uint32_t total = order.quantity + node->reserve;
+    if (newPrice == order.price) {
+        if (newQty <= total) {
+            uint32_t cut = total - newQty;
+            uint32_t fromReserve = std::min(cut, node->reserve);
+            level->shrinkReserve(node, fromReserve);
+            level->fill(node, cut - fromReserve);
+            // A cut that stays within the hidden reserve is invisible
+            if (cut > fromReserve) markDepth(order.side);
+        } else {
+            level->unlink(node);
+            // Only icebergs keep a displayQty (see insertLimitOrder)
+            if (order.displayQty > 0) node->reserve += newQty - total;
+            else order.quantity = newQty;
+            level->pushBack(node);
+            markDepth(order.side);
+        }
+        ENGINE_LOG_DEBUG("Modified order %" PRIu64 ": qty %" PRIu32, orderId, newQty);
+        return;
+    }
+
+    // Price change: lift the order off its level and re-enter it at the new
+    // price, matching first like any incoming limit order
+    Order moved = order;
+    moved.price = newPrice;
+    moved.quantity = newQty;
+
+    level->unlink(node);
+    markDepth(order.side);
+    if (level->empty()) eraseLevel(order.side, order.price);
+    releaseNode(node);
+
+    ENGINE_LOG_DEBUG("Modified order %" PRIu64 ": %" PRIu32 " @ %" PRId64, orderId, newQty, newPrice);
+    if (inAuction)
+        lastStatus = insertLimitOrder(moved);
+    else if (moved.side == Side::BUY)
+        match<Side::BUY, LimitPolicy>(moved, onTrade);
+    else
+        match<Side::SELL, LimitPolicy>(moved, onTrade);
+
+    if (!stops.empty()) releaseStops(onTrade);
+}
+
+template <template <Side> class Levels, typename Allocation>
+void BasicOrderBook<Levels, Allocation>::modifyOrder(uint64_t orderId, Price newPrice, uint32_t newQty,
+                                         std::vector<Trade>& out) {
+    modifyOrder(orderId, newPrice, newQty, [&out](const Trade& t) { out.push_back(t); });
+}
+
+template <template <Side> class Levels, typename Allocation>
+void BasicOrderBook<Levels, Allocation>::printTopLevels() const {
     std::cout << "Top of Book:\n";
 
     if (!bids.empty()) {
-        auto bestBid = bids.begin();
-        std::cout << "Best Bid: " << bestBid->first
-                  << " (" << bestBid->second.size() << " orders)\n";
+        std::cout << "Best Bid: " << fromTicks(bids.bestPrice(), tickSize)
+                  << " (" << bids.best().orderCount << " orders)\n";
     } else {
         std::cout << "Best Bid: None\n";
     }
 
     if (!asks.empty()) {
-        auto bestAsk = asks.begin();
-        std::cout << "Best Ask: " << bestAsk->first
-                  << " (" << bestAsk->second.size() << " orders)\n";
+        std::cout << "Best Ask: " << fromTicks(asks.bestPrice(), tickSize)
+                  << " (" << asks.best().orderCount << " orders)\n";
     } else {
         std::cout << "Best Ask: None\n";
     }
 }
 
-std::vector<Trade> OrderBook::matchLimitBuy(Order order) {
-    std::vector<Trade> trades;
+template <template <Side> class Levels, typename Allocation>
+template <Side S, typename Policy>
+void BasicOrderBook<Levels, Allocation>::match(Order order, TradeSink onTrade) {
+    auto& opposite = oppositeLevels<S>();
+    constexpr Side restingSide = S == Side::BUY ? Side::SELL : Side::BUY;
 
-    while (!asks.empty() && order.quantity > 0) {
-        auto bestAskIt = asks.begin();
-        double bestAskPrice = bestAskIt->first;
+    // Resting orders of this owner must not trade with it
+    const uint32_t selfOwner = order.stp != SelfTradePrevention::NONE && order.ownerId != 0
+                                   ? order.ownerId : NO_SELF_MATCH;
 
-        if (order.price < bestAskPrice)
-            break;
+    while (!opposite.empty() && order.quantity > 0) {
+        Price bestPrice = opposite.bestPrice();
 
-        auto& sellQueue = bestAskIt->second;
-        Order& sellOrder = sellQueue.front();
+        if (!Policy::template crosses<S>(order.price, bestPrice))
+            break;
 
-        uint32_t tradedQty = std::min(order.quantity, sellOrder.quantity);
+        auto& queue = opposite.best();
+        OrderNode* restingNode = queue.front();
+        Order& resting = restingNode->order;
+
+        if constexpr (Allocation::proRata) {
+            // A level the aggressor cannot clear is shared out; otherwise
+            // every order on it fills completely, same as FIFO
+            if (order.quantity < queue.totalQty) {
+                allocateProRata<S>(order, queue, bestPrice, selfOwner, onTrade);
+                if (queue.empty())
+                    popBestLevel(restingSide);
+                continue;
+            }
+        }
 
-        std::cout << "[DEBUG] MATCH BUY: bestAskPrice=" << bestAskPrice
-                  << " order.price=" << order.price
-                  << " tradedQty=" << tradedQty << std::endl;
+        if (resting.ownerId == selfOwner) [[unlikely]] {
+            preventSelfTrade(order, restingNode);
+            if (queue.empty())
+                popBestLevel(restingSide);
+            continue;
+        }
 
-        trades.push_back(Trade{
-            nextTradeId++,
-            order.orderId,
-            sellOrder.orderId,
-            bestAskPrice,
-            tradedQty,
-            order.timestamp
-        });
+        uint32_t tradedQty = std::min(order.quantity, resting.quantity);
 
-        order.quantity -= tradedQty;
-        sellOrder.quantity -= tradedQty;
+        ENGINE_LOG_DEBUG("MATCH %s: bestPrice=%" PRId64 " order.price=%" PRId64 " tradedQty=%" PRIu32,
+                         S == Side::BUY ? "BUY" : "SELL", bestPrice, order.price, tradedQty);
 
-        if (sellOrder.quantity == 0) {
-            auto it = orderIdToPrice.find(sellOrder.orderId);
-            if (it != orderIdToPrice.end()) orderIdToPrice.erase(it);
-            sellQueue.pop_front();
-        }
+        fillResting<S>(order, restingNode, tradedQty, bestPrice, onTrade);
 
-        if (sellQueue.empty())
-            asks.erase(bestAskIt);
+        if (queue.empty())
+            popBestLevel(restingSide);
     }
 
-    // FIX: leftover qty must NOT be inserted if MARKET order
-    if (order.quantity > 0 && order.type == OrderType::LIMIT) {
-        insertLimitOrder(order);
+    if (Policy::rests && order.quantity > 0) {
+        // A remainder that rests keeps the matching verdict (SELF_TRADE);
+        // one that cannot rest reports why
+        OrderStatus rested = insertLimitOrder(order);
+        if (rested != OrderStatus::ACCEPTED) lastStatus = rested;
     }
-
-    return trades;
 }
 
-std::vector<Trade> OrderBook::matchLimitSell(Order order) {
-    std::vector<Trade> trades;
+template <template <Side> class Levels, typename Allocation>
+template <Side S>
+void BasicOrderBook<Levels, Allocation>::fillResting(Order& order, OrderNode* resting, uint32_t qty,
+                                                     Price price, TradeSink onTrade) {
+    onTrade(Trade{
+        nextTradeId++,
+        S == Side::BUY ? order.orderId : resting->order.orderId,
+        S == Side::BUY ? resting->order.orderId : order.orderId,
+        price,
+        qty,
+        order.timestamp,
+        order.symbolId
+    });
+
+    order.quantity -= qty;
+    resting->level->fill(resting, qty);
+    markDepth(resting->order.side);
+    lastTradePrice = price;
+    hasLastTrade = true;
+
+    settle(resting);
+}
 
-    while (!bids.empty() && order.quantity > 0) {
-        auto bestBidIt = bids.begin();
-        double bestBidPrice = bestBidIt->first;
+template <template <Side> class Levels, typename Allocation>
+template <Side S>
+void BasicOrderBook<Levels, Allocation>::allocateProRata(Order& order, PriceLevel& queue, Price price,
+                                                         uint32_t selfOwner, TradeSink onTrade) {
+    // Self-trade prevention first, so the split only covers tradable orders
+    if (selfOwner != NO_SELF_MATCH) {
+        OrderNode* last = queue.tail;
+        for (OrderNode* node = queue.front(), *next; node; node = next) {
+            bool isLast = node == last;
+            next = node->next;
+            if (node->order.ownerId == selfOwner) preventSelfTrade(order, node);
+            if (isLast || order.quantity == 0) break;
+        }
+        // Whatever is left may now clear the level; the FIFO path handles that
+        if (order.quantity == 0 || queue.empty() || order.quantity >= queue.totalQty) return;
+    }
 
-        if (order.price > bestBidPrice)
-            break;
+    // Orders refilled from an iceberg reserve go behind `last` and wait for
+    // the next aggressor
+    OrderNode* last = queue.tail;
+    OrderNode* node = queue.front();
+    uint64_t levelQty = queue.totalQty;
+
+    if (topOrderPriority) {
+        OrderNode* next = node->next;
+        uint32_t topQty = node->order.quantity;
+        bool isLast = node == last;
+        fillResting<S>(order, node, std::min(order.quantity, topQty), price, onTrade);
+        if (isLast || order.quantity == 0) return;
+        levelQty -= topQty;
+        node = next;
+    }
 
-        auto& buyQueue = bestBidIt->second;
-        Order& buyOrder = buyQueue.front();
+    // Single pass over the level: each order gets its share of what is still
+    // to allocate, relative to the quantity still to visit. Shares round up,
+    // so earlier orders absorb the rounding, and the last order visited
+    // takes exactly what remains - nothing is left over.
+    for (OrderNode* next; node; node = next) {
+        bool isLast = node == last;
+        next = node->next;
+        uint32_t qty = node->order.quantity;
+        uint64_t share = (uint64_t(order.quantity) * qty + levelQty - 1) / levelQty;
+        levelQty -= qty;
+        if (share > 0) fillResting<S>(order, node, uint32_t(share), price, onTrade);
+        if (isLast || order.quantity == 0) break;
+    }
+}
 
-        uint32_t tradedQty = std::min(order.quantity, buyOrder.quantity);
+template <template <Side> class Levels, typename Allocation>
+void BasicOrderBook<Levels, Allocation>::settle(OrderNode* node) {
+    if (node->order.quantity > 0) return;
+    if (node->reserve > 0) {
+        node->level->replenish(node, node->order.displayQty);
+    } else {
+        node->level->unlink(node);
+        releaseNode(node);
+    }
+}
 
-        std::cout << "[DEBUG] MATCH SELL: bestBidPrice=" << bestBidPrice
-                  << " order.price=" << order.price
-                  << " tradedQty=" << tradedQty << std::endl;
+template <template <Side> class Levels, typename Allocation>
+void BasicOrderBook<Levels, Allocation>::startAuction() {
+    inAuction = true;
+    ENGINE_LOG_INFO("Auction started");
+}
 
-        trades.push_back(Trade{
-            nextTradeId++,
-            buyOrder.orderId,
-            order.orderId,
-            bestBidPrice,
-            tradedQty,
-            order.timestamp
-        });
+template <template <Side> class Levels, typename Allocation>
+std::optional<Price> BasicOrderBook<Levels, Allocation>::uncross(uint64_t timestamp, TradeSink onTrade) {
+    inAuction = false;
+    if (bids.empty() || asks.empty() || bids.bestPrice() < asks.bestPrice()) {
+        ENGINE_LOG_INFO("Auction ended: book not crossed");
+        if (!stops.empty()) releaseStops(onTrade);
+        return std::nullopt;
+    }
+    Price lo = asks.bestPrice();
+    Price hi = bids.bestPrice();
+
+    // Crossed levels of each side, ascending. Executable volume only changes
+    // at level prices, so these are the only candidates - the tick ladder
+    // between them would add ticks that can never win.
+    std::vector<std::pair<Price, uint64_t>> buys, sells;
+    bids.forEach([&](Price price, const PriceLevel& level) {
+        if (price < lo) return false;
+        buys.emplace_back(price, level.totalQty + level.hiddenQty);
+        return true;
+    });
+    std::reverse(buys.begin(), buys.end());
+    asks.forEach([&](Price price, const PriceLevel& level) {
+        if (price > hi) return false;
+        sells.emplace_back(price, level.totalQty + level.hiddenQty);
+        return true;
+    });
+
+    // One price axis with each side's quantity at each price
+    std::vector<Price> prices;
+    std::vector<uint64_t> demand, supply;
+    for (size_t i = 0, j = 0; i < buys.size() || j < sells.size();) {
+        bool takeBuy = j == sells.size() || (i < buys.size() && buys[i].first <= sells[j].first);
+        Price price = takeBuy ? buys[i].first : sells[j].first;
+        prices.push_back(price);
+        demand.push_back(i < buys.size() && buys[i].first == price ? buys[i++].second : 0);
+        supply.push_back(j < sells.size() && sells[j].first == price ? sells[j++].second : 0);
+    }
 
-        order.quantity -= tradedQty;
-        buyOrder.quantity -= tradedQty;
+    // Bids take any price at or below their limit, asks any at or above
+    std::inclusive_scan(demand.rbegin(), demand.rend(), demand.rbegin());
+    std::inclusive_scan(supply.begin(), supply.end(), supply.begin());
+
+    Price reference = hasLastTrade ? lastTradePrice : lo + (hi - lo) / 2;
+    auto distance = [reference](Price p) { return p > reference ? p - reference : reference - p; };
+    size_t best = 0;
+    uint64_t bestVolume = 0;
+    uint64_t bestImbalance = 0;
+    for (size_t k = 0; k < prices.size(); ++k) {
+        uint64_t volume = std::min(demand[k], supply[k]);
+        uint64_t imbalance = std::max(demand[k], supply[k]) - volume;
+        bool better = volume != bestVolume ? volume > bestVolume
+                    : imbalance != bestImbalance ? imbalance < bestImbalance
+                    : distance(prices[k]) < distance(prices[best]);
+        if (k == 0 || better) {
+            best = k;
+            bestVolume = volume;
+            bestImbalance = imbalance;
+        }
+    }
 
-        if (buyOrder.quantity == 0) {
-            auto it = orderIdToPrice.find(buyOrder.orderId);
-            if (it != orderIdToPrice.end()) orderIdToPrice.erase(it);
-            buyQueue.pop_front();
+    // Pair bids from the top with asks from the bottom, in time priority,
+    // all at the one price, until one side has nothing left at that price.
+    // Without self-trades that is exactly bestVolume.
+    Price price = prices[best];
+    uint64_t traded = 0;
+    while (!bids.empty() && !asks.empty() && bids.bestPrice() >= price && asks.bestPrice() <= price) {
+        OrderNode* buyer = bids.best().front();
+        OrderNode* seller = asks.best().front();
+        uint32_t qty = std::min(buyer->order.quantity, seller->order.quantity);
+
+        if (buyer->order.ownerId == seller->order.ownerId && buyer->order.ownerId != 0) [[unlikely]] {
+            // The later of the two is the incoming order, as in continuous
+            // matching, and its mode applies
+            bool buyerNewer = buyer->order.timestamp >= seller->order.timestamp;
+            OrderNode* newer = buyerNewer ? buyer : seller;
+            OrderNode* older = buyerNewer ? seller : buyer;
+            SelfTradePrevention mode = newer->order.stp;
+            if (mode != SelfTradePrevention::NONE) {
+                ENGINE_LOG_DEBUG("Self-trade prevented in auction: %" PRIu64 " vs %" PRIu64 " (owner %" PRIu32 ")",
+                                 newer->order.orderId, older->order.orderId, newer->order.ownerId);
+                if (mode == SelfTradePrevention::DECREMENT) {
+                    buyer->level->fill(buyer, qty);
+                    seller->level->fill(seller, qty);
+                    settle(buyer);
+                    settle(seller);
+                } else {
+                    if (mode != SelfTradePrevention::CANCEL_NEWEST) {
+                        older->level->unlink(older);
+                        releaseNode(older);
+                    }
+                    if (mode != SelfTradePrevention::CANCEL_OLDEST) {
+                        newer->level->unlink(newer);
+                        releaseNode(newer);
+                    }
+                }
+                if (bids.best().empty()) popBestLevel(Side::BUY);
+                if (asks.best().empty()) popBestLevel(Side::SELL);
+                continue;
+            }
         }
 
-        if (buyQueue.empty())
-            bids.erase(bestBidIt);
+        onTrade(Trade{nextTradeId++, buyer->order.orderId, seller->order.orderId,
+                      price, qty, timestamp, buyer->order.symbolId});
+
+        buyer->level->fill(buyer, qty);
+        seller->level->fill(seller, qty);
+        settle(buyer);
+        settle(seller);
+        if (bids.best().empty()) popBestLevel(Side::BUY);
+        if (asks.best().empty()) popBestLevel(Side::SELL);
+        traded += qty;
     }
 
-    // FIX here also
-    if (order.quantity > 0 && order.type == OrderType::LIMIT) {
-        insertLimitOrder(order);
+    changes |= DEPTH_CHANGED;
+    if (traded == 0) {
+        ENGINE_LOG_INFO("Auction ended: every crossing pair was a self-trade");
+        return std::nullopt;
     }
+    lastTradePrice = price;
+    hasLastTrade = true;
+    ENGINE_LOG_INFO("Auction uncrossed: %" PRIu64 " @ %" PRId64, traded, price);
 
-    return trades;
+    if (!stops.empty()) releaseStops(onTrade);
+    return price;
 }
 
-std::vector<DepthLevel> OrderBook::getDepth(bool isBid, int levels) const {
-    std::vector<DepthLevel> out;
-    out.reserve(levels);
+template <template <Side> class Levels, typename Allocation>
+std::optional<Price> BasicOrderBook<Levels, Allocation>::uncross(uint64_t timestamp, std::vector<Trade>& out) {
+    return uncross(timestamp, [&out](const Trade& t) { out.push_back(t); });
+}
 
-    if (isBid) {
-        for (auto it = bids.begin(); it != bids.end() && levels > 0; ++it) {
-            uint32_t sum = 0;
-            for (auto &o : it->second) sum += o.quantity;
-            out.push_back({it->first, sum});
-            levels--;
-        }
+template <template <Side> class Levels, typename Allocation>
+void BasicOrderBook<Levels, Allocation>::preventSelfTrade(Order& order, OrderNode* resting) {
+    PriceLevel& queue = *resting->level;
+    SelfTradePrevention mode = order.stp;
+
+    ENGINE_LOG_DEBUG("Self-trade prevented: order %" PRIu64 " vs resting %" PRIu64 " (owner %" PRIu32 ")",
+                     order.orderId, resting->order.orderId, order.ownerId);
+
+    if (mode == SelfTradePrevention::DECREMENT) {
+        // Like a fill on both sides, minus the trade
+        uint32_t qty = std::min(order.quantity, resting->order.quantity);
+        order.quantity -= qty;
+        queue.fill(resting, qty);
+        markDepth(resting->order.side);
+        settle(resting);
     } else {
-        for (auto it = asks.begin(); it != asks.end() && levels > 0; ++it) {
-            uint32_t sum = 0;
-            for (auto &o : it->second) sum += o.quantity;
-            out.push_back({it->first, sum});
-            levels--;
+        if (mode != SelfTradePrevention::CANCEL_NEWEST) {
+            queue.unlink(resting);
+            markDepth(resting->order.side);
+            releaseNode(resting);
         }
+        if (mode != SelfTradePrevention::CANCEL_OLDEST) order.quantity = 0;
     }
 
+    if (mode != SelfTradePrevention::CANCEL_OLDEST) lastStatus = OrderStatus::SELF_TRADE;
+}
+
+template <template <Side> class Levels, typename Allocation>
+std::vector<DepthLevel> BasicOrderBook<Levels, Allocation>::getDepth(bool isBid, int levels) const {
+    std::vector<DepthLevel> out(levels > 0 ? size_t(levels) : 0);
+    out.resize(getDepth(isBid, out.data(), out.size()));
     return out;
 }
 
+template <template <Side> class Levels, typename Allocation>
+size_t BasicOrderBook<Levels, Allocation>::getDepth(bool isBid, DepthLevel* out, size_t levels) const {
+    size_t n = 0;
+    if (levels == 0) return n;
+
+    auto collect = [&](Price price, const PriceLevel& level) {
+        out[n++] = {price, level.totalQty, level.orderCount};
+        return n < levels;
+    };
+
+    if (isBid) bids.forEach(collect);
+    else asks.forEach(collect);
+
+    return n;
+}
+
+template class BasicOrderBook<MapLevels, FifoAllocation>;
+template class BasicOrderBook<LadderLevels, FifoAllocation>;
+template class BasicOrderBook<MapLevels, ProRataAllocation>;
+template class BasicOrderBook<LadderLevels, ProRataAllocation>;
@@ -3,9 +3,8 @@
 #include <iostream>
 #include <iomanip>
 #include <chrono>
-#include "DBLogger.hpp"
-
-static DBLogger DB;
+#include <algorithm>
+#include "Log.hpp"
 
 // helper timestamp (ns)
 static uint64_t now_nanos() {
@@ -13,138 +12,421 @@ static uint64_t now_nanos() {
     return (uint64_t)duration_cast<std::chrono::nanoseconds>(steady_clock::now().time_since_epoch()).count();
 }
 
-std::vector<Trade> OrderBookManager::addOrder(const std::string& symbol, const Order& order) {
-    // Log the incoming order
-    DB.logOrder(order);
-    
-    // Ensure book exists
-    auto &book = books[symbol]; // default-construct if missing
+static double tickOf(const AnyOrderBook& book) {
+    return std::visit([](const auto& b) { return b.tickSize; }, book);
+}
 
-    // Snapshot before
-    TopOfBook before = snapshotTop(symbol);
+static BookType typeOf(const AnyOrderBook& book) {
+    bool ladder = std::holds_alternative<LadderOrderBook>(book) ||
+                  std::holds_alternative<ProRataLadderOrderBook>(book);
+    return ladder ? BookType::LADDER : BookType::MAP;
+}
 
-    // Per-book trades (tradeIds might be local to that book)
-    std::vector<Trade> localTrades = book.addOrder(order);
+static MatchingRule ruleOf(const AnyOrderBook& book) {
+    if (std::holds_alternative<OrderBook>(book) || std::holds_alternative<LadderOrderBook>(book))
+        return MatchingRule::FIFO;
+    bool top = std::visit([](const auto& b) { return b.topOrderPriority; }, book);
+    return top ? MatchingRule::PRO_RATA_TOP : MatchingRule::PRO_RATA;
+}
 
-    // Remap their tradeId to a global sequence and return
-    std::vector<Trade> out;
-    out.reserve(localTrades.size());
-    for (auto &t : localTrades) {
-        Trade tt = t;
-        tt.tradeId = globalTradeId++;
-        out.push_back(tt);
+static const BookCapacity& capacityOf(const AnyOrderBook& book) {
+    return std::visit([](const auto& b) -> const BookCapacity& { return b.capacity; }, book);
+}
+
+// No resting orders and no pending stops: a rebuild would lose nothing
+static bool isEmpty(const AnyOrderBook& book) {
+    return std::visit([](const auto& b) { return b.empty(); }, book);
+}
 
-        // Emit trade market-data line as well (to stderr)
-        emitTradeMD(tt, symbol);
+// Books are not movable (levels point into them), so they are built in place
+static void makeBook(AnyOrderBook& slot, BookType type, MatchingRule rule, double tickSize,
+                     BookCapacity capacity, ExpiryWheel* expiries, OrderIndex* index) {
+    bool ladder = type == BookType::LADDER;
+    if (rule == MatchingRule::FIFO) {
+        if (ladder) slot.emplace<LadderOrderBook>(tickSize, capacity);
+        else slot.emplace<OrderBook>(tickSize, capacity);
+    } else {
+        if (ladder) slot.emplace<ProRataLadderOrderBook>(tickSize, capacity);
+        else slot.emplace<ProRataOrderBook>(tickSize, capacity);
     }
+    std::visit([&](auto& b) {
+        b.expiries = expiries;
+        b.index = index;
+        b.topOrderPriority = rule == MatchingRule::PRO_RATA_TOP;
+    }, slot);
+}
 
-    // Snapshot after
-    TopOfBook after = snapshotTop(symbol);
+// Replace an empty book with one of other settings. An auction started
+// before the symbol's first order stays on.
+static void rebuildBook(AnyOrderBook& book, BookType type, MatchingRule rule, const BookCapacity& capacity,
+                        ExpiryWheel* expiries, OrderIndex* index) {
+    bool auction = std::visit([](const auto& b) { return b.isInAuction(); }, book);
+    makeBook(book, type, rule, tickOf(book), capacity, expiries, index);
+    if (auction) std::visit([](auto& b) { b.startAuction(); }, book);
+}
 
-    // If top-of-book changed, emit an update
-    bool changed = false;
-    if (before.hasBid != after.hasBid) changed = true;
-    else if (before.hasAsk != after.hasAsk) changed = true;
-    else if (before.hasBid && after.hasBid && before.bestBid != after.bestBid) changed = true;
-    else if (before.hasAsk && after.hasAsk && before.bestAsk != after.bestAsk) changed = true;
+OrderBookManager::OrderBookManager(size_t maxTimers, size_t maxOrders)
+    : expiries(now_nanos() / EXPIRY_TICK_NS, maxTimers), orderIndex(maxOrders), globalTradeId(1) {}
 
-    if (changed) {
-        prevTop[symbol] = after;
-        emitMarketDataTop(symbol, after);
+SymbolId OrderBookManager::symbolId(const std::string& symbol) {
+    SymbolId id = symbols.intern(symbol);
+    if (id >= books.size()) {
+        books.resize(id + 1);
+        lastChanges.resize(id + 1, NO_CHANGE);
     }
+    if (!books[id]) {
+        books[id] = std::make_unique<AnyOrderBook>();
+        makeBook(*books[id], defaultBookType, defaultMatchingRule, DEFAULT_TICK_SIZE, defaultCapacity, &expiries, &orderIndex);
+    }
+    return id;
+}
 
-    return out;
+void OrderBookManager::setTradeIdSequence(uint64_t first, uint64_t stride) {
+    globalTradeId = first;
+    tradeIdStride = stride;
 }
 
-void OrderBookManager::cancelOrder(const std::string& symbol, uint64_t orderId) {
-    auto it = books.find(symbol);
-    if (it == books.end()) {
-        std::cout << "Symbol " << symbol << " not found\n";
+uint64_t OrderBookManager::takeTradeId() {
+    uint64_t id = globalTradeId;
+    globalTradeId += tradeIdStride;
+    return id;
+}
+
+AnyOrderBook* OrderBookManager::findBook(SymbolId symbol) const {
+    return symbol < books.size() ? books[symbol].get() : nullptr;
+}
+
+void OrderBookManager::executeOrder(AnyOrderBook& book, const Order& order, TradeSink onTrade,
+                                    OrderStatus* status) {
+    double tick = tickOf(book);
+
+    // Book tradeIds are local to that book; remap each fill to the global
+    // sequence on its way through
+    auto remap = [&](const Trade& t) {
+        Trade tt = t;
+        tt.tradeId = takeTradeId();
+
+        // Emit trade market-data line as well (stderr and WS clients)
+        emitTradeMD(tt, tick);
+        onTrade(tt);
+    };
+    std::visit([&](auto& b) {
+        b.addOrder(order, remap);
+        if (status) *status = b.lastStatus;
+    }, book);
+}
+
+void OrderBookManager::addOrder(const Order& order, TradeSink onTrade, OrderStatus* status) {
+    AnyOrderBook* book = findBook(order.symbolId);
+    if (!book) {
+        ENGINE_LOG_WARN("Order %" PRIu64 ": unknown symbol id %" PRIu32, order.orderId, order.symbolId);
+        if (status) *status = OrderStatus::UNKNOWN_SYMBOL;
         return;
     }
-    // snapshot before
-    TopOfBook before = snapshotTop(symbol);
 
-    it->second.cancelOrder(orderId);
+    executeOrder(*book, order, onTrade, status);
+
+    publishChanges(order.symbolId, *book);
+}
+
+void OrderBookManager::addOrders(std::span<const Order> batch, TradeSink onTrade, OrderStatus* statuses) {
+    // Books collect their changes until taken, so one publish per touched
+    // symbol at the end covers the whole batch
+    touched.clear();
+    for (size_t i = 0; i < batch.size(); ++i) {
+        const Order& order = batch[i];
+        OrderStatus* status = statuses ? &statuses[i] : nullptr;
 
-    TopOfBook after = snapshotTop(symbol);
-    bool changed = false;
-    if (before.hasBid != after.hasBid) changed = true;
-    else if (before.hasAsk != after.hasAsk) changed = true;
-    else if (before.hasBid && after.hasBid && before.bestBid != after.bestBid) changed = true;
-    else if (before.hasAsk && after.hasAsk && before.bestAsk != after.bestAsk) changed = true;
+        AnyOrderBook* book = findBook(order.symbolId);
+        if (!book) {
+            ENGINE_LOG_WARN("Order %" PRIu64 ": unknown symbol id %" PRIu32, order.orderId, order.symbolId);
+            if (status) *status = OrderStatus::UNKNOWN_SYMBOL;
+            continue;
+        }
+        if (std::find(touched.begin(), touched.end(), order.symbolId) == touched.end())
+            touched.push_back(order.symbolId);
 
-    if (changed) {
-        prevTop[symbol] = after;
-        emitMarketDataTop(symbol, after);
+        executeOrder(*book, order, onTrade, status);
     }
+
+    for (SymbolId symbol : touched) publishChanges(symbol, *books[symbol]);
 }
 
-OrderBook* OrderBookManager::getOrderBook(const std::string& symbol) {
-    auto it = books.find(symbol);
-    if (it == books.end()) return nullptr;
-    return &it->second;
+void OrderBookManager::addOrders(std::span<const Order> batch, std::vector<Trade>& out, OrderStatus* statuses) {
+    addOrders(batch, [&out](const Trade& t) { out.push_back(t); }, statuses);
 }
 
-void OrderBookManager::printTopLevels() const {
-    if (books.empty()) {
-        std::cout << "No orderbooks yet.\n";
+void OrderBookManager::addOrder(const Order& order, std::vector<Trade>& out, OrderStatus* status) {
+    addOrder(order, [&out](const Trade& t) { out.push_back(t); }, status);
+}
+
+std::vector<Trade> OrderBookManager::addOrder(const Order& order, OrderStatus* status) {
+    std::vector<Trade> trades;
+    addOrder(order, trades, status);
+    return trades;
+}
+
+void OrderBookManager::cancelOrder(SymbolId symbol, uint64_t orderId) {
+    AnyOrderBook* book = findBook(symbol);
+    if (!book) {
+        ENGINE_LOG_INFO("Cancel: symbol id %" PRIu32 " not found", symbol);
         return;
     }
-    for (auto& kv : books) {
-        std::cout << "=== " << kv.first << " ===\n";
-        kv.second.printTopLevels();
+    std::visit([&](auto& b) { b.cancelOrder(orderId); }, *book);
+
+    publishChanges(symbol, *book);
+}
+
+bool OrderBookManager::cancelOrder(uint64_t orderId) {
+    const OrderLocation* location = orderIndex.find(orderId);
+    if (!location) {
+        ENGINE_LOG_INFO("Cancel: order %" PRIu64 " not found", orderId);
+        return false;
     }
+    cancelOrder(location->symbolId, orderId);
+    return true;
 }
 
-void OrderBookManager::printTopLevels(const std::string& symbol) const {
-    auto it = books.find(symbol);
-    if (it == books.end()) {
-        std::cout << "No book for " << symbol << "\n";
+void OrderBookManager::modifyOrder(uint64_t orderId, Price newPrice, uint32_t newQty,
+                                   TradeSink onTrade, OrderStatus* status) {
+    const OrderLocation* location = orderIndex.find(orderId);
+    // Pending stops have no resting quantity or price to change
+    if (!location || !location->node) {
+        ENGINE_LOG_INFO("Modify: order %" PRIu64 " not found", orderId);
+        if (status) *status = OrderStatus::UNKNOWN_ORDER;
         return;
     }
-    std::cout << "=== " << symbol << " ===\n";
-    it->second.printTopLevels();
+    modifyOrder(location->symbolId, orderId, newPrice, newQty, onTrade, status);
+}
+
+void OrderBookManager::modifyOrder(uint64_t orderId, Price newPrice, uint32_t newQty,
+                                   std::vector<Trade>& out, OrderStatus* status) {
+    modifyOrder(orderId, newPrice, newQty, [&out](const Trade& t) { out.push_back(t); }, status);
 }
 
-TopOfBook OrderBookManager::snapshotTop(const std::string& symbol) const {
-    TopOfBook res;
-    auto it = books.find(symbol);
-    if (it == books.end()) return res;
+bool OrderBookManager::findOrder(uint64_t orderId, OrderInfo& out) const {
+    const OrderLocation* location = orderIndex.find(orderId);
+    if (!location) return false;
 
-    const auto& book = it->second;
+    out.symbolId = location->symbolId;
+    if (const OrderNode* node = location->node) {
+        out.side = node->order.side;
+        out.type = node->order.type;
+        out.price = node->order.price;
+        out.openQty = node->order.quantity + node->reserve;
+        out.pendingStop = false;
+        return true;
+    }
 
-    // For bids (descending map) begin() is best
-    if (!book.bids.empty()) {
-        res.hasBid = true;
-        res.bestBid = book.bids.begin()->first;
-    } else {
-        res.hasBid = false;
+    const Order* stop = std::visit([&](const auto& b) { return b.findStop(orderId); },
+                                   *books[location->symbolId]);
+    out.side = stop->side;
+    out.type = stop->type;
+    out.price = stop->price;
+    out.openQty = stop->quantity;
+    out.pendingStop = true;
+    return true;
+}
+
+void OrderBookManager::modifyOrder(SymbolId symbol, uint64_t orderId, Price newPrice, uint32_t newQty,
+                                   TradeSink onTrade, OrderStatus* status) {
+    AnyOrderBook* book = findBook(symbol);
+    if (!book) {
+        ENGINE_LOG_INFO("Modify: symbol id %" PRIu32 " not found", symbol);
+        if (status) *status = OrderStatus::UNKNOWN_SYMBOL;
+        return;
     }
+    double tick = tickOf(*book);
+
+    // A repriced order can trade; fills get global ids like addOrder's
+    auto remap = [&](const Trade& t) {
+        Trade tt = t;
+        tt.tradeId = takeTradeId();
+        emitTradeMD(tt, tick);
+        onTrade(tt);
+    };
+    std::visit([&](auto& b) {
+        b.modifyOrder(orderId, newPrice, newQty, remap);
+        if (status) *status = b.lastStatus;
+    }, *book);
+
+    publishChanges(symbol, *book);
+}
+
+void OrderBookManager::modifyOrder(SymbolId symbol, uint64_t orderId, Price newPrice, uint32_t newQty,
+                                   std::vector<Trade>& out, OrderStatus* status) {
+    modifyOrder(symbol, orderId, newPrice, newQty, [&out](const Trade& t) { out.push_back(t); }, status);
+}
+
+size_t OrderBookManager::massCancel(SymbolId symbol, uint32_t ownerId, SideFilter sides) {
+    touched.clear();
+    size_t removed = 0;
 
-    // For asks (ascending map) begin() is best ask
-    if (!book.asks.empty()) {
-        res.hasAsk = true;
-        res.bestAsk = book.asks.begin()->first;
+    auto cancelIn = [&](SymbolId id) {
+        AnyOrderBook* book = findBook(id);
+        if (!book) return;
+        size_t n = std::visit([&](auto& b) { return b.cancelAll(ownerId, sides); }, *book);
+        if (n == 0) return;
+        removed += n;
+        touched.push_back(id);
+        publishChanges(id, *book);
+    };
+
+    if (symbol != INVALID_SYMBOL) {
+        cancelIn(symbol);
     } else {
-        res.hasAsk = false;
+        for (SymbolId id = 0; id < books.size(); ++id) cancelIn(id);
     }
 
-    return res;
+    ENGINE_LOG_INFO("Mass cancel: %zu orders across %zu symbols", removed, touched.size());
+    return removed;
+}
+
+bool OrderBookManager::startAuction(SymbolId symbol) {
+    AnyOrderBook* book = findBook(symbol);
+    if (!book) return false;
+    std::visit([](auto& b) { b.startAuction(); }, *book);
+    return true;
+}
+
+bool OrderBookManager::uncross(SymbolId symbol, TradeSink onTrade) {
+    AnyOrderBook* book = findBook(symbol);
+    if (!book) return false;
+    double tick = tickOf(*book);
+
+    auto remap = [&](const Trade& t) {
+        Trade tt = t;
+        tt.tradeId = takeTradeId();
+        emitTradeMD(tt, tick);
+        onTrade(tt);
+    };
+    std::visit([&](auto& b) { b.uncross(now_nanos(), remap); }, *book);
+
+    publishChanges(symbol, *book);
+    return true;
+}
+
+bool OrderBookManager::uncross(SymbolId symbol, std::vector<Trade>& out) {
+    return uncross(symbol, [&out](const Trade& t) { out.push_back(t); });
+}
+
+size_t OrderBookManager::expireOrders(uint64_t now) {
+    touched.clear();
+    // Whole ticks: an order goes at most one tick after its expireTime, never before
+    expired.clear();
+    expiries.advance(now / EXPIRY_TICK_NS, [&](const OrderExpiry& e) { expired.push_back(e); });
+    if (expired.empty()) return 0;
+
+    for (const OrderExpiry& e : expired) {
+        std::visit([&](auto& b) { b.expireOrder(e.orderId); }, *books[e.symbolId]);
+        if (std::find(touched.begin(), touched.end(), e.symbolId) == touched.end())
+            touched.push_back(e.symbolId);
+    }
+
+    for (SymbolId symbol : touched) publishChanges(symbol, *books[symbol]);
+
+    ENGINE_LOG_INFO("Expired %zu GTD orders across %zu symbols", expired.size(), touched.size());
+    return expired.size();
+}
+
+std::vector<DepthLevel> OrderBookManager::getDepth(SymbolId symbol, bool isBid, int levels) const {
+    const AnyOrderBook* book = findBook(symbol);
+    if (!book) return {};
+    return std::visit([&](const auto& b) { return b.getDepth(isBid, levels); }, *book);
+}
+
+size_t OrderBookManager::getDepth(SymbolId symbol, bool isBid, DepthLevel* out, size_t levels) const {
+    const AnyOrderBook* book = findBook(symbol);
+    if (!book) return 0;
+    return std::visit([&](const auto& b) { return b.getDepth(isBid, out, levels); }, *book);
+}
+
+bool OrderBookManager::setTickSize(const std::string& symbol, double tickSize) {
+    if (tickSize <= 0.0) return false;
+
+    AnyOrderBook& book = *books[symbolId(symbol)];
+    if (!isEmpty(book)) return false;
+
+    std::visit([&](auto& b) { b.tickSize = tickSize; }, book);
+    return true;
+}
+
+double OrderBookManager::tickSize(SymbolId symbol) const {
+    const AnyOrderBook* book = findBook(symbol);
+    if (!book) return DEFAULT_TICK_SIZE;
+    return tickOf(*book);
+}
+
+bool OrderBookManager::setBookType(const std::string& symbol, BookType type) {
+    AnyOrderBook& book = *books[symbolId(symbol)];
+    if (!isEmpty(book)) return false;
+
+    BookCapacity capacity = capacityOf(book);
+    rebuildBook(book, type, ruleOf(book), capacity, &expiries, &orderIndex);
+    return true;
+}
+
+bool OrderBookManager::setMatchingRule(const std::string& symbol, MatchingRule rule) {
+    AnyOrderBook& book = *books[symbolId(symbol)];
+    if (!isEmpty(book)) return false;
+
+    BookCapacity capacity = capacityOf(book);
+    rebuildBook(book, typeOf(book), rule, capacity, &expiries, &orderIndex);
+    return true;
+}
+
+bool OrderBookManager::setBookCapacity(const std::string& symbol, const BookCapacity& capacity) {
+    if (capacity.orders == 0 || capacity.levels == 0) return false;
+
+    AnyOrderBook& book = *books[symbolId(symbol)];
+    if (!isEmpty(book)) return false;
+
+    rebuildBook(book, typeOf(book), ruleOf(book), capacity, &expiries, &orderIndex);
+    return true;
+}
+
+void OrderBookManager::printTopLevels() const {
+    if (books.empty()) {
+        std::cout << "No orderbooks yet.\n";
+        return;
+    }
+    for (SymbolId id = 0; id < books.size(); ++id) {
+        std::cout << "=== " << symbols.name(id) << " ===\n";
+        std::visit([](const auto& b) { b.printTopLevels(); }, *books[id]);
+    }
+}
+
+void OrderBookManager::printTopLevels(const std::string& symbol) const {
+    const AnyOrderBook* book = findBook(symbols.find(symbol));
+    if (!book) {
+        std::cout << "No book for " << symbol << "\n";
+        return;
+    }
+    std::cout << "=== " << symbol << " ===\n";
+    std::visit([](const auto& b) { b.printTopLevels(); }, *book);
+}
+
+void OrderBookManager::publishChanges(SymbolId symbol, AnyOrderBook& book) {
+    std::visit([&](auto& b) {
+        BookChanges changes = b.takeChanges();
+        lastChanges[symbol] = changes;
+        if (changes & BBO_CHANGED) emitMarketDataTop(symbol, b.top, b.tickSize);
+    }, book);
 }
 
-void OrderBookManager::emitMarketDataTop(const std::string& symbol, const TopOfBook& top) const {
-    // Emit JSON line to stderr so it's separable from stdout (trades)
+void OrderBookManager::emitMarketDataTop(SymbolId symbol, const TopOfBook& top, double tickSize) const {
+    if (!marketData) return;
+    // Emit JSON line to stderr (separable from stdout trades) and WS clients
     // Example:
     // {"type":"top","symbol":"AAPL","bestBid":100.5,"bestAsk":100.6,"timestamp":12345}
     std::ostringstream ss;
     ss << std::fixed << std::setprecision(6);
-    ss << "{\"type\":\"top\",\"symbol\":\"" << symbol << "\"";
+    ss << "{\"type\":\"top\",\"symbol\":\"" << symbols.name(symbol) << "\"";
 
-    if (top.hasBid) ss << ",\"bestBid\":" << top.bestBid;
+    if (top.hasBid) ss << ",\"bestBid\":" << fromTicks(top.bestBid, tickSize);
     else ss << ",\"bestBid\":null";
 
-    if (top.hasAsk) ss << ",\"bestAsk\":" << top.bestAsk;
+    if (top.hasAsk) ss << ",\"bestAsk\":" << fromTicks(top.bestAsk, tickSize);
     else ss << ",\"bestAsk\":null";
 
     ss << ",\"timestamp\":" << now_nanos();
@@ -152,14 +434,15 @@ void OrderBookManager::emitMarketDataTop(const std::string& symbol, const TopOfB
     MarketDataServerAPI::broadcast(ss.str());
 }
 
-void OrderBookManager::emitTradeMD(const Trade& t, const std::string& symbol) const {
-    // Emit trade as market-data JSON line to stderr as well, helpful for dashboard
+void OrderBookManager::emitTradeMD(const Trade& t, double tickSize) const {
+    if (!marketData) return;
+    // Emit trade as market-data JSON line to stderr and WS clients, for the dashboard
     // {"type":"trade","symbol":"AAPL","tradeId":..., "price":..., "quantity":..., "buyOrderId":..., "sellOrderId":..., "timestamp":...}
     std::ostringstream ss;
     ss << std::fixed << std::setprecision(6);
-    ss << "{\"type\":\"trade\",\"symbol\":\"" << symbol << "\","
+    ss << "{\"type\":\"trade\",\"symbol\":\"" << symbols.name(t.symbolId) << "\","
        << "\"tradeId\":" << t.tradeId << ","
-       << "\"price\":" << t.price << ","
+       << "\"price\":" << fromTicks(t.price, tickSize) << ","
        << "\"quantity\":" << t.quantity << ","
        << "\"buyOrderId\":" << t.buyOrderId << ","
        << "\"sellOrderId\":" << t.sellOrderId << ","
@@ -0,0 +1,354 @@
+#include "ShardedOrderBookManager.hpp"
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+#include <pthread.h>
+#include <sched.h>
+#include "Log.hpp"
+
+// helper timestamp (ns), same clock as OrderBookManager's
+static uint64_t now_nanos() {
+    using namespace std::chrono;
+    return (uint64_t)duration_cast<std::chrono::nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+static void pinToCpu(int cpu) {
+    if (cpu < 0) return;
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+        ENGINE_LOG_WARN("Shard thread: could not pin to cpu %d", cpu);
+#else
+    ENGINE_LOG_WARN("Shard thread: pinning to cpu %d not supported here", cpu);
+#endif
+}
+
+// Passes of the run loop between clock reads while it is busy or spinning
+static constexpr unsigned EXPIRY_CHECK_INTERVAL = 64;
+
+ShardedOrderBookManager::ShardedOrderBookManager(size_t shardCount, std::vector<int> cpus, bool publishDepth)
+    : publishDepth(publishDepth) {
+    if (shardCount == 0) shardCount = 1;
+    for (size_t k = 0; k < shardCount; ++k) {
+        auto shard = std::make_unique<Shard>();
+        shard->cpu = k < cpus.size() ? cpus[k] : int(k % std::max(1u, std::thread::hardware_concurrency()));
+        shard->books.setTradeIdSequence(k + 1, shardCount);
+        // Fills and tops leave through the outbox only
+        shard->books.setMarketData(false);
+        shards.push_back(std::move(shard));
+    }
+    // Threads start once every shard exists; gatewayId() needs the count
+    for (size_t k = 0; k < shardCount; ++k)
+        shards[k]->thread = std::thread(&ShardedOrderBookManager::run, this, k);
+}
+
+ShardedOrderBookManager::~ShardedOrderBookManager() {
+    stop();
+}
+
+void ShardedOrderBookManager::stop() {
+    running.store(false, std::memory_order_release);
+    for (auto& shard : shards) {
+        if (shard->thread.joinable()) shard->thread.join();
+    }
+}
+
+SymbolId ShardedOrderBookManager::addSymbol(const std::string& symbol, const SymbolConfig& config) {
+    SymbolId existing = symbols.find(symbol);
+    if (existing != INVALID_SYMBOL) return existing;
+    if (symbol.size() > MAX_SYMBOL_NAME) {
+        ENGINE_LOG_WARN("Symbol %s: name longer than %zu characters", symbol.c_str(), MAX_SYMBOL_NAME);
+        return INVALID_SYMBOL;
+    }
+
+    // The id the registry is about to hand out decides the shard
+    SymbolId id = SymbolId(symbols.size());
+    bool queued = push(shardOf(id), id, [&](ShardRequest& r) {
+        r.kind = ShardRequest::Kind::ADD_SYMBOL;
+        r.config = config;
+        std::memcpy(r.name, symbol.c_str(), symbol.size() + 1);
+    });
+    if (!queued) {
+        ENGINE_LOG_WARN("Symbol %s: shard queue full", symbol.c_str());
+        return INVALID_SYMBOL;
+    }
+
+    symbols.intern(symbol);
+    tickSizes.push_back(config.tickSize);
+    return id;
+}
+
+SubmitStatus ShardedOrderBookManager::submit(const Order& order) {
+    return send(order.symbolId, [&](ShardRequest& r) {
+        r.kind = ShardRequest::Kind::NEW;
+        r.order = order;
+    });
+}
+
+SubmitStatus ShardedOrderBookManager::submit(std::span<const Order> batch, size_t& queued) {
+    queued = 0;
+    // Each shard applies its part when the order marked batchEnd arrives
+    lastOfShard.assign(shards.size(), batch.size());
+    for (size_t i = 0; i < batch.size(); ++i) {
+        if (!symbols.contains(batch[i].symbolId)) return SubmitStatus::UNKNOWN_SYMBOL;
+        lastOfShard[shardOf(batch[i].symbolId)] = i;
+    }
+
+    for (; queued < batch.size(); ++queued) {
+        const Order& order = batch[queued];
+        size_t shard = shardOf(order.symbolId);
+        bool pushed = push(shard, order.symbolId, [&](ShardRequest& r) {
+            r.kind = ShardRequest::Kind::BATCH;
+            r.order = order;
+            r.batchEnd = lastOfShard[shard] == queued;
+        });
+        if (!pushed) return SubmitStatus::QUEUE_FULL;
+    }
+    return SubmitStatus::QUEUED;
+}
+
+SubmitStatus ShardedOrderBookManager::cancel(SymbolId symbol, uint64_t orderId) {
+    return send(symbol, [&](ShardRequest& r) {
+        r.kind = ShardRequest::Kind::CANCEL;
+        r.orderId = orderId;
+    });
+}
+
+SubmitStatus ShardedOrderBookManager::modify(SymbolId symbol, uint64_t orderId, Price newPrice, uint32_t newQty) {
+    return send(symbol, [&](ShardRequest& r) {
+        r.kind = ShardRequest::Kind::MODIFY;
+        r.orderId = orderId;
+        r.price = newPrice;
+        r.quantity = newQty;
+    });
+}
+
+SubmitStatus ShardedOrderBookManager::cancel(uint64_t orderId) {
+    bool queued = push(orderId % shards.size(), INVALID_SYMBOL, [&](ShardRequest& r) {
+        r.kind = ShardRequest::Kind::CANCEL;
+        r.orderId = orderId;
+    });
+    return queued ? SubmitStatus::QUEUED : SubmitStatus::QUEUE_FULL;
+}
+
+SubmitStatus ShardedOrderBookManager::modify(uint64_t orderId, double newPrice, uint32_t newQty) {
+    bool queued = push(orderId % shards.size(), INVALID_SYMBOL, [&](ShardRequest& r) {
+        r.kind = ShardRequest::Kind::MODIFY;
+        r.orderId = orderId;
+        r.decimalPrice = newPrice;
+        r.quantity = newQty;
+    });
+    return queued ? SubmitStatus::QUEUED : SubmitStatus::QUEUE_FULL;
+}
+
+SubmitStatus ShardedOrderBookManager::startAuction(SymbolId symbol) {
+    return send(symbol, [](ShardRequest& r) { r.kind = ShardRequest::Kind::AUCTION; });
+}
+
+SubmitStatus ShardedOrderBookManager::uncross(SymbolId symbol) {
+    return send(symbol, [](ShardRequest& r) { r.kind = ShardRequest::Kind::UNCROSS; });
+}
+
+SubmitStatus ShardedOrderBookManager::massCancel(SymbolId symbol, uint32_t ownerId, SideFilter sides) {
+    auto fill = [&](ShardRequest& r) {
+        r.kind = ShardRequest::Kind::MASS_CANCEL;
+        r.ownerId = ownerId;
+        r.sides = sides;
+    };
+    if (symbol != INVALID_SYMBOL) return send(symbol, fill);
+
+    SubmitStatus result = SubmitStatus::QUEUED;
+    for (size_t k = 0; k < shards.size(); ++k) {
+        if (!push(k, INVALID_SYMBOL, fill)) result = SubmitStatus::QUEUE_FULL;
+    }
+    return result;
+}
+
+template <typename F>
+void ShardedOrderBookManager::publish(Shard& shard, F&& fill) {
+    // Dropping a fill is not an option: wait for the consumer, unless the
+    // manager is shutting down and nobody will poll again
+    auto stamped = [&](ShardEvent& e) {
+        e.seq = shard.seq;
+        e.requestTs = shard.requestTs;
+        fill(e);
+    };
+    while (!shard.outbox.tryPushWith(stamped)) {
+        if (!running.load(std::memory_order_relaxed)) return;
+        std::this_thread::yield();
+    }
+}
+
+void ShardedOrderBookManager::publishDepthOf(size_t index, SymbolId local) {
+    Shard& shard = *shards[index];
+    // A request that left every displayed level alone needs no snapshot
+    if (!(shard.books.changesOf(local) & DEPTH_CHANGED)) return;
+    // Straight into the ring slot, no intermediate copies
+    publish(shard, [&](ShardEvent& e) {
+        e.kind = ShardEvent::Kind::DEPTH;
+        e.symbolId = gatewayId(index, local);
+        e.bidCount = uint32_t(shard.books.getDepth(local, true, e.bids.data(), e.bids.size()));
+        e.askCount = uint32_t(shard.books.getDepth(local, false, e.asks.data(), e.asks.size()));
+    });
+}
+
+void ShardedOrderBookManager::handle(size_t index, const ShardRequest& request) {
+    Shard& shard = *shards[index];
+    OrderBookManager& books = shard.books;
+    SymbolId local = request.symbolId == INVALID_SYMBOL ? INVALID_SYMBOL : localId(request.symbolId);
+    shard.seq = request.seq;
+    shard.requestTs = request.timestamp;
+
+    auto onTrade = [&](const Trade& t) {
+        publish(shard, [&](ShardEvent& e) {
+            e.kind = ShardEvent::Kind::TRADE;
+            e.symbolId = gatewayId(index, t.symbolId);
+            e.trade = t;
+            e.trade.symbolId = e.symbolId;
+        });
+    };
+    auto onStatus = [&](uint64_t orderId, OrderStatus status) {
+        publish(shard, [&](ShardEvent& e) {
+            e.kind = ShardEvent::Kind::STATUS;
+            e.symbolId = local == INVALID_SYMBOL ? INVALID_SYMBOL : gatewayId(index, local);
+            e.orderId = orderId;
+            e.status = status;
+        });
+    };
+
+    OrderStatus status = OrderStatus::ACCEPTED;
+    switch (request.kind) {
+        case ShardRequest::Kind::ADD_SYMBOL: {
+            const SymbolConfig& config = request.config;
+            std::string name(request.name);
+            // The shard's defaults only shape the book created next, so the
+            // book is built once with its settings instead of rebuilt per setter
+            books.setDefaultBookType(config.type);
+            books.setDefaultMatchingRule(config.rule);
+            books.setDefaultCapacity(config.capacity);
+            SymbolId assigned = books.symbolId(name);
+            if (assigned != local)
+                ENGINE_LOG_ERROR("Shard %zu: %s interned as %" PRIu32 ", expected %" PRIu32,
+                                 index, name.c_str(), assigned, local);
+            books.setTickSize(name, config.tickSize);
+            return;
+        }
+        case ShardRequest::Kind::NEW: {
+            Order order = request.order;
+            order.symbolId = local;
+            books.addOrder(order, onTrade, &status);
+            onStatus(order.orderId, status);
+            break;
+        }
+        case ShardRequest::Kind::BATCH: {
+            Order order = request.order;
+            order.symbolId = local;
+            shard.batch.push_back(order);
+            if (!request.batchEnd) return;
+
+            shard.batchStatus.resize(shard.batch.size());
+            books.addOrders(shard.batch, onTrade, shard.batchStatus.data());
+            for (size_t i = 0; i < shard.batch.size(); ++i) {
+                publish(shard, [&](ShardEvent& e) {
+                    e.kind = ShardEvent::Kind::STATUS;
+                    e.symbolId = gatewayId(index, shard.batch[i].symbolId);
+                    e.orderId = shard.batch[i].orderId;
+                    e.status = shard.batchStatus[i];
+                });
+            }
+            shard.batch.clear();
+            if (publishDepth) {
+                for (SymbolId s : books.touchedSymbols()) publishDepthOf(index, s);
+            }
+            return;
+        }
+        case ShardRequest::Kind::CANCEL:
+        case ShardRequest::Kind::MODIFY: {
+            Price price = request.price;
+            // By orderId alone: the order's own book, if it is still live
+            if (local == INVALID_SYMBOL) {
+                OrderInfo info;
+                if (!books.findOrder(request.orderId, info)) {
+                    ENGINE_LOG_INFO("Shard %zu: order %" PRIu64 " not found", index, request.orderId);
+                    if (request.kind == ShardRequest::Kind::MODIFY)
+                        onStatus(request.orderId, OrderStatus::UNKNOWN_ORDER);
+                    return;
+                }
+                local = info.symbolId;
+                double tick = books.tickSize(local);
+                if (request.kind == ShardRequest::Kind::MODIFY && !isOnTick(request.decimalPrice, tick)) {
+                    onStatus(request.orderId, OrderStatus::OFF_TICK);
+                    return;
+                }
+                price = toTicks(request.decimalPrice, tick);
+            }
+            if (request.kind == ShardRequest::Kind::CANCEL) {
+                books.cancelOrder(local, request.orderId);
+                break;
+            }
+            books.modifyOrder(local, request.orderId, price, request.quantity, onTrade, &status);
+            onStatus(request.orderId, status);
+            break;
+        }
+        case ShardRequest::Kind::AUCTION:
+            books.startAuction(local);
+            break;
+        case ShardRequest::Kind::UNCROSS:
+            books.uncross(local, onTrade);
+            publish(shard, [&](ShardEvent& e) {
+                e.kind = ShardEvent::Kind::UNCROSSED;
+                e.symbolId = request.symbolId;
+            });
+            break;
+        case ShardRequest::Kind::MASS_CANCEL:
+            books.massCancel(local, request.ownerId, request.sides);
+            if (publishDepth) {
+                for (SymbolId s : books.touchedSymbols()) publishDepthOf(index, s);
+            }
+            return;
+    }
+
+    if (publishDepth) publishDepthOf(index, local);
+}
+
+void ShardedOrderBookManager::run(size_t index) {
+    Shard& shard = *shards[index];
+    pinToCpu(shard.cpu);
+
+    ShardRequest request;
+    IdleBackoff backoff;
+    unsigned sinceExpiry = 0;
+    uint64_t nextExpiry = 0;
+    for (;;) {
+        bool popped = shard.inbox.tryPop(request);
+        if (popped) {
+            handle(index, request);
+            backoff.reset();
+        }
+
+        // GTD expiry once per wheel tick. The clock is read every so often,
+        // or on every pass once the loop is slow enough to afford it.
+        if (++sinceExpiry >= EXPIRY_CHECK_INTERVAL || backoff.settled()) {
+            sinceExpiry = 0;
+            uint64_t now = now_nanos();
+            if (now >= nextExpiry) {
+                nextExpiry = now + EXPIRY_TICK_NS;
+                shard.seq = shard.requestTs = 0;
+                if (shard.books.expireOrders(now) > 0 && publishDepth) {
+                    for (SymbolId s : shard.books.touchedSymbols()) publishDepthOf(index, s);
+                }
+            }
+        }
+
+        if (!popped) {
+            if (!running.load(std::memory_order_acquire)) {
+                // Everything queued before stop() is applied before leaving
+                while (shard.inbox.tryPop(request)) handle(index, request);
+                break;
+            }
+            backoff.wait();
+        }
+    }
+}
@@ -0,0 +1,12 @@
+#include "SymbolRegistry.hpp"
+
+SymbolId SymbolRegistry::intern(const std::string& name) {
+    auto [it, inserted] = ids.try_emplace(name, SymbolId(names.size()));
+    if (inserted) names.push_back(name);
+    return it->second;
+}
+
+SymbolId SymbolRegistry::find(const std::string& name) const {
+    auto it = ids.find(name);
+    return it == ids.end() ? INVALID_SYMBOL : it->second;
+}
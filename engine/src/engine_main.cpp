@@ -4,12 +4,18 @@
 #include <vector>
 #include <chrono>
 #include <unistd.h>
+#include <poll.h>
 #include "DBLogger.hpp"
 #include "OrderBookManager.hpp"
 #include "MarketDataServer.hpp"
+#include "ClientMessage.hpp"
+#include "Log.hpp"
 
 static DBLogger DB;
 
+// Longest the loop blocks on stdin before checking GTD expiries again
+static constexpr int EXPIRY_POLL_MS = 1;
+
 // helper to get monotonic timestamp in nanoseconds
 static uint64_t now_nanos() {
     using namespace std::chrono;
@@ -17,12 +23,30 @@ static uint64_t now_nanos() {
         std::chrono::steady_clock::now().time_since_epoch()).count();
 }
 
-static void printTradeJSON(const Trade& t) {
+static inline std::string trim(const std::string& s) {
+    size_t start = 0;
+    while (start < s.size() && (unsigned char)s[start] <= 32) start++;
+
+    size_t end = s.size();
+    while (end > start && (unsigned char)s[end - 1] <= 32) end--;
+    return s.substr(start, end - start);
+}
+
+// Client prices must sit on the symbol's tick grid; a limit is never
+// rounded to a price the client did not ask for
+static bool checkTicks(const ClientMessage& m, double tick) {
+    bool stopOk = m.kind != ClientMessage::Kind::NEW || isOnTick(m.stopPrice, tick);
+    if (isOnTick(m.price, tick) && stopOk) return true;
+    std::cerr << "Order " << m.orderId << " rejected: price not a multiple of tick size " << tick << "\n";
+    return false;
+}
+
+static void printTradeJSON(const Trade& t, double tickSize) {
     std::cout << "{"
               << "\"tradeId\":" << t.tradeId << ","
               << "\"buyOrderId\":" << t.buyOrderId << ","
               << "\"sellOrderId\":" << t.sellOrderId << ","
-              << "\"price\":" << t.price << ","
+              << "\"price\":" << fromTicks(t.price, tickSize) << ","
               << "\"quantity\":" << t.quantity << ","
               << "\"timestamp\":" << t.timestamp
               << "}" << std::endl;
@@ -30,22 +54,22 @@ static void printTradeJSON(const Trade& t) {
 
 static void printUsage() {
     std::cout << "Commands:\n"
-              << "  NEW,<orderId>,<SYMBOL>,<BUY/SELL>,<LIMIT/MARKET>,<price or 0>,<qty>\n"
-              << "  CANCEL,<orderId>\n"
+              << "  NEW,<orderId>,<SYMBOL>,<BUY/SELL>,<LIMIT/MARKET/STOP/STOP_LIMIT>,<price or 0>,<qty>[,<GTC/IOC/FOK/GTD=<ms>>][,PEAK=<qty>][,STOP=<price>][,OWNER=<id>][,STP=<NEWEST/OLDEST/BOTH/DECREMENT>]\n"
+              << "  BATCH ... END   (NEW lines in between are applied as one batch)\n"
+              << "  CANCEL,<orderId>   (or CANCEL,<SYMBOL>,<orderId>)\n"
+              << "  STATUS,<orderId>   (open quantity and state of a live order)\n"
+              << "  MASSCANCEL,<SYMBOL or *>[,<BUY/SELL/*>][,<owner>]   (owner omitted or 0 = all owners)\n"
+              << "  AUCTION,<SYMBOL>   (orders rest without matching until UNCROSS)\n"
+              << "  UNCROSS,<SYMBOL>   (execute the auction at the volume-maximising price)\n"
+              << "  MODIFY,[<SYMBOL>,]<orderId>,<newPrice>,<newQty>   (qty down at same price keeps priority)\n"
+              << "  TICK,<SYMBOL>,<tickSize>   (before the symbol's first order)\n"
+              << "  BOOK,<SYMBOL or *>,<MAP/LADDER>   (book backend; * sets the default)\n"
+              << "  RULE,<SYMBOL or *>,<FIFO/PRO_RATA/PRO_RATA_TOP>   (matching rule; * sets the default)\n"
+              << "  POOL,<SYMBOL or *>,<maxOrders>,<maxLevels>   (preallocated book capacity)\n"
               << "  SNAP or SNAP,<SYMBOL>\n"
               << "  QUIT\n";
 }
 
-static inline std::string trim(const std::string& s) {
-    size_t start = 0;
-    while (start < s.size() && (unsigned char)s[start] <= 32) start++;
-
-    size_t end = s.size();
-    while (end > start && (unsigned char)s[end - 1] <= 32) end--;
-
-    return s.substr(start, end - start);
-}
-
 int main() {
     // Initialize database logger
     DB.init("trading.db");
@@ -56,18 +80,39 @@ int main() {
 
     OrderBookManager mgr;
     std::string line;
+    std::vector<Trade> trades; // reused across orders
 
     std::cout << "Mini Trading Engine CLI (type HELP for usage)\n";
 
-    auto process_line = [&](const std::string &l_in) {
-        std::string l = l_in;
-        if (l.empty()) return;
-        // ignore comments
-        if (l[0] == '#') return;
-        auto pos = l.find('#');
-        if (pos != std::string::npos) l = l.substr(0, pos);
-        l = trim(l);
-        if (l.empty()) return;
+    // Decoded NEW -> engine order: resolves the symbol and converts prices to ticks
+    auto toOrder = [&](const ClientMessage& m) {
+        SymbolId symbolId = mgr.symbolId(m.symbol);
+        double tick = mgr.tickSize(symbolId);
+
+        Order o{};
+        o.orderId = m.orderId;
+        o.symbolId = symbolId;
+        o.side = m.side;
+        o.type = m.type;
+        o.price = toTicks(m.price, tick);
+        o.quantity = m.quantity;
+        o.timestamp = now_nanos();
+        o.timeInForce = m.timeInForce;
+        o.expireTime = (m.timeInForce == TimeInForce::GTD ? o.timestamp + m.lifetimeMs * 1'000'000 : 0);
+        o.displayQty = m.displayQty;
+        o.stopPrice = toTicks(m.stopPrice, tick);
+        o.ownerId = m.ownerId;
+        o.stp = m.stp;
+        return o;
+    };
+
+    // Orders collected between BATCH and END
+    bool batching = false;
+    std::vector<Order> batch;
+    std::vector<OrderStatus> batchStatus;
+
+    // Configuration and session commands, as the cleaned-up text line
+    auto process_text = [&](const std::string &l) {
         if (l == "QUIT" || l == "EXIT") {
             // indicate quit by throwing a signal via exception or return code
             throw std::runtime_error("QUIT");
@@ -92,98 +137,278 @@ int main() {
         if (parts.empty()) return;
 
         const std::string cmd = parts[0];
-        if (cmd == "NEW") {
-            if (parts.size() != 7) {
-                std::cerr << "NEW command requires 6 args. Type HELP.\n";
+        if (cmd == "BATCH") {
+            if (batching) { std::cerr << "BATCH already open\n"; return; }
+            batching = true;
+            batch.clear();
+        } else if (cmd == "END") {
+            if (!batching) { std::cerr << "END without BATCH\n"; return; }
+            batching = false;
+            batchStatus.resize(batch.size());
+            trades.clear();
+            mgr.addOrders(batch, trades, batchStatus.data());
+            for (size_t i = 0; i < batch.size(); ++i) {
+                const Order& o = batch[i];
+                if (batchStatus[i] == OrderStatus::NOT_FILLABLE) std::cerr << "FOK order " << o.orderId << " not fillable\n";
+                DB.logOrder(o, mgr.symbolName(o.symbolId), mgr.tickSize(o.symbolId));
+            }
+            for (const auto &t : trades) {
+                double tick = mgr.tickSize(t.symbolId);
+                DB.logTrade(t, mgr.symbolName(t.symbolId), tick);
+                printTradeJSON(t, tick);
+            }
+        } else if (cmd == "BOOK") {
+            if (parts.size() != 3) {
+                std::cerr << "BOOK requires symbol and type (BOOK,<SYMBOL>,<MAP/LADDER>)\n";
+                return;
+            }
+            BookType type;
+            if (parts[2] == "MAP") type = BookType::MAP;
+            else if (parts[2] == "LADDER") type = BookType::LADDER;
+            else { std::cerr << "Invalid book type\n"; return; }
+
+            if (parts[1] == "*") mgr.setDefaultBookType(type);
+            else if (!mgr.setBookType(parts[1], type)) {
+                std::cerr << "Cannot change book type for " << parts[1] << " (book not empty)\n";
+            }
+
+        } else if (cmd == "RULE") {
+            if (parts.size() != 3) {
+                std::cerr << "RULE requires symbol and rule (RULE,<SYMBOL>,<FIFO/PRO_RATA/PRO_RATA_TOP>)\n";
+                return;
+            }
+            MatchingRule rule;
+            if (parts[2] == "FIFO") rule = MatchingRule::FIFO;
+            else if (parts[2] == "PRO_RATA") rule = MatchingRule::PRO_RATA;
+            else if (parts[2] == "PRO_RATA_TOP") rule = MatchingRule::PRO_RATA_TOP;
+            else { std::cerr << "Invalid matching rule\n"; return; }
+
+            if (parts[1] == "*") mgr.setDefaultMatchingRule(rule);
+            else if (!mgr.setMatchingRule(parts[1], rule)) {
+                std::cerr << "Cannot change matching rule for " << parts[1] << " (book not empty)\n";
+            }
+
+        } else if (cmd == "POOL") {
+            if (parts.size() != 4) {
+                std::cerr << "POOL requires symbol and sizes (POOL,<SYMBOL>,<maxOrders>,<maxLevels>)\n";
+                return;
+            }
+            BookCapacity capacity;
+            try {
+                capacity.orders = std::stoull(parts[2]);
+                capacity.levels = std::stoull(parts[3]);
+            } catch(...) { std::cerr << "Invalid pool sizes\n"; return; }
+
+            if (parts[1] == "*") mgr.setDefaultCapacity(capacity);
+            else if (!mgr.setBookCapacity(parts[1], capacity)) {
+                std::cerr << "Cannot resize pools for " << parts[1] << " (invalid size or book not empty)\n";
+            }
+
+        } else if (cmd == "TICK") {
+            if (parts.size() != 3) {
+                std::cerr << "TICK requires symbol and tick size (TICK,<SYMBOL>,<tickSize>)\n";
+                return;
+            }
+            double tick = 0.0;
+            try { tick = std::stod(parts[2]); } catch(...) { std::cerr << "Invalid tick size\n"; return; }
+            if (!mgr.setTickSize(parts[1], tick)) {
+                std::cerr << "Cannot set tick size for " << parts[1] << " (invalid size or book not empty)\n";
+            }
+
+        } else if (cmd == "STATUS") {
+            if (parts.size() != 2) {
+                std::cerr << "STATUS requires orderId (STATUS,<orderId>)\n";
                 return;
             }
             uint64_t orderId = 0;
             try { orderId = std::stoull(parts[1]); } catch(...) { std::cerr << "Invalid orderId\n"; return; }
-            std::string symbol = parts[2];
-            std::string sideStr = parts[3];
-            std::string typeStr = parts[4];
-            double price = 0.0;
-            uint32_t qty = 0;
-            try { price = std::stod(parts[5]); qty = static_cast<uint32_t>(std::stoul(parts[6])); } catch(...) { std::cerr << "Invalid price/qty\n"; return; }
-
-            Side side;
-            if (sideStr == "BUY") side = Side::BUY;
-            else if (sideStr == "SELL") side = Side::SELL;
-            else { std::cerr << "Invalid side\n"; return; }
-
-            OrderType type;
-            if (typeStr == "LIMIT") type = OrderType::LIMIT;
-            else if (typeStr == "MARKET") type = OrderType::MARKET;
-            else { std::cerr << "Invalid type\n"; return; }
-
-            Order o;
-            o.orderId = orderId;
-            o.symbol = symbol;
-            o.side = side;
-            o.type = type;
-            o.price = (type == OrderType::MARKET ? 0.0 : price);
-            o.quantity = qty;
-            o.timestamp = now_nanos();
-
-            auto trades = mgr.addOrder(symbol, o);
-            DB.logOrder(o);
+            OrderInfo info;
+            if (!mgr.findOrder(orderId, info)) {
+                std::cerr << "Unknown order " << orderId << "\n";
+                return;
+            }
+            double tick = mgr.tickSize(info.symbolId);
+            std::cout << "{\"orderId\":" << orderId
+                      << ",\"symbol\":\"" << mgr.symbolName(info.symbolId) << "\""
+                      << ",\"side\":\"" << (info.side == Side::BUY ? "BUY" : "SELL") << "\""
+                      << ",\"price\":" << fromTicks(info.price, tick)
+                      << ",\"openQty\":" << info.openQty
+                      << ",\"state\":\"" << (info.pendingStop ? "PENDING_STOP" : "RESTING") << "\""
+                      << "}" << std::endl;
+        } else if (cmd == "AUCTION" || cmd == "UNCROSS") {
+            if (parts.size() != 2) {
+                std::cerr << cmd << " requires symbol (" << cmd << ",<SYMBOL>)\n";
+                return;
+            }
+            // An opening auction may start before the symbol's first order
+            if (cmd == "AUCTION") {
+                mgr.startAuction(mgr.symbolId(parts[1]));
+                return;
+            }
+            SymbolId symbolId = mgr.findSymbol(parts[1]);
+            if (symbolId == INVALID_SYMBOL) {
+                std::cerr << "Unknown symbol " << parts[1] << "\n";
+                return;
+            }
+            double tick = mgr.tickSize(symbolId);
+            trades.clear();
+            mgr.uncross(symbolId, trades);
+            for (const auto &t : trades) DB.logTrade(t, parts[1], tick);
+            for (const auto &t : trades) printTradeJSON(t, tick);
+        } else if (cmd == "MASSCANCEL") {
+            if (parts.size() < 2 || parts.size() > 4) {
+                std::cerr << "MASSCANCEL requires symbol, optional side and owner (MASSCANCEL,<SYMBOL or *>[,<BUY/SELL/*>][,<owner>])\n";
+                return;
+            }
+            SymbolId symbolId = INVALID_SYMBOL;
+            if (parts[1] != "*") {
+                symbolId = mgr.findSymbol(parts[1]);
+                if (symbolId == INVALID_SYMBOL) {
+                    std::cerr << "Unknown symbol " << parts[1] << "\n";
+                    return;
+                }
+            }
+            SideFilter sides = SideFilter::BOTH;
+            if (parts.size() > 2) {
+                if (parts[2] == "BUY") sides = SideFilter::BUY;
+                else if (parts[2] == "SELL") sides = SideFilter::SELL;
+                else if (parts[2] != "*") { std::cerr << "Invalid side\n"; return; }
+            }
+            uint32_t owner = 0;
+            if (parts.size() > 3) {
+                try { owner = static_cast<uint32_t>(std::stoul(parts[3])); } catch(...) { std::cerr << "Invalid owner\n"; return; }
+            }
+            size_t n = mgr.massCancel(symbolId, owner, sides);
+            std::cout << "{\"cancelled\":" << n << "}" << std::endl;
+        } else {
+            std::cerr << "Unknown command: " << cmd << "\n";
+        }
+    };
+
+    // One decoded command, from stdin or a market-data WS client
+    auto apply = [&](const ClientMessage& m) {
+        switch (m.kind) {
+        case ClientMessage::Kind::TEXT:
+            process_text(m.text);
+            break;
+
+        case ClientMessage::Kind::NEW: {
+            Order o = toOrder(m);
+            if (!checkTicks(m, mgr.tickSize(o.symbolId))) return;
+            if (batching) { batch.push_back(o); return; }
+
+            const std::string& symbol = mgr.symbolName(o.symbolId);
+            double tick = mgr.tickSize(o.symbolId);
+            trades.clear();
+            OrderStatus status;
+            mgr.addOrder(o, trades, &status);
+            if (status == OrderStatus::NOT_FILLABLE) std::cerr << "FOK order " << o.orderId << " not fillable\n";
+            if (status == OrderStatus::SELF_TRADE) std::cerr << "Order " << o.orderId << " cut short by self-trade prevention\n";
+            if (status == OrderStatus::TIMER_EXHAUSTED) std::cerr << "GTD order " << o.orderId << " rejected: no expiry timer\n";
+            DB.logOrder(o, symbol, tick);
             for (const auto &t : trades) {
-                DB.logTrade(t, symbol);
+                DB.logTrade(t, symbol, tick);
             }
-            for (const auto &t : trades) printTradeJSON(t);
+            for (const auto &t : trades) printTradeJSON(t, tick);
+            break;
+        }
 
-        } else if (cmd == "CANCEL") {
-            if (parts.size() != 3 && parts.size() != 2) {
-                std::cerr << "CANCEL requires orderId and optional symbol (CANCEL,<symbol>,<orderId> or CANCEL,<orderId>)\n";
+        case ClientMessage::Kind::CANCEL: {
+            if (m.symbol[0] == '\0') {
+                if (!mgr.cancelOrder(m.orderId)) std::cerr << "Unknown order " << m.orderId << "\n";
                 return;
             }
-            if (parts.size() == 3) {
-                std::string symbol = parts[1];
-                uint64_t orderId = std::stoull(parts[2]);
-                mgr.cancelOrder(symbol, orderId);
+            SymbolId symbolId = mgr.findSymbol(m.symbol);
+            if (symbolId == INVALID_SYMBOL) {
+                std::cerr << "Unknown symbol " << m.symbol << "\n";
+                return;
+            }
+            mgr.cancelOrder(symbolId, m.orderId);
+            break;
+        }
+
+        case ClientMessage::Kind::MODIFY: {
+            // Without a symbol the order's own book decides the tick size
+            SymbolId symbolId;
+            OrderInfo info;
+            if (m.symbol[0] != '\0') {
+                symbolId = mgr.findSymbol(m.symbol);
+                if (symbolId == INVALID_SYMBOL) {
+                    std::cerr << "Unknown symbol " << m.symbol << "\n";
+                    return;
+                }
+            } else if (mgr.findOrder(m.orderId, info)) {
+                symbolId = info.symbolId;
             } else {
-                uint64_t orderId = std::stoull(parts[1]);
-                // if symbol missing, attempt cancel across books by probing or just print message
-                // For simplicity, try all books
-                // (OrderBookManager::cancelOrder currently expects symbol; to cancel globally we'd add code)
-                // Here we just print message: user should pass symbol
-                std::cerr << "Please provide symbol for cancel: CANCEL,<symbol>,<orderId>\n";
+                std::cerr << "Unknown order " << m.orderId << "\n";
+                return;
             }
-        } else {
-            std::cerr << "Unknown command: " << cmd << "\n";
+            double tick = mgr.tickSize(symbolId);
+            if (!checkTicks(m, tick)) return;
+            OrderStatus status;
+            trades.clear();
+            mgr.modifyOrder(symbolId, m.orderId, toTicks(m.price, tick), m.quantity, trades, &status);
+            if (status == OrderStatus::UNKNOWN_ORDER) {
+                std::cerr << "Unknown order " << m.orderId << "\n";
+                return;
+            }
+            const std::string& symbol = mgr.symbolName(symbolId);
+            for (const auto &t : trades) DB.logTrade(t, symbol, tick);
+            for (const auto &t : trades) printTradeJSON(t, tick);
+            break;
+        }
         }
     };
 
+    auto process_line = [&](const std::string &l) {
+        ClientMessage m;
+        if (decodeClientMessage(l, m)) apply(m);
+    };
+
+    // Lets in_avail() see lines already read ahead, so poll() is only asked
+    // about input that has not arrived yet
+    std::ios::sync_with_stdio(false);
+    const bool interactive = isatty(fileno(stdin));
+    bool prompt = true;
+    ClientMessage client_msg;
+
     try {
-        // main loop: process queued client messages first, then stdin input
+        // main loop: expire GTD orders, process queued client messages, then stdin input
         while (true) {
-            // Handle client-sent messages (WS) — non-blocking: process all available
-            std::string client_msg;
+            mgr.expireOrders(now_nanos());
+
+            // Handle client-sent messages (WS), decoded by the network
+            // threads — non-blocking: process all available
             while (MarketDataServerAPI::try_pop_client_message(client_msg)) {
                 try {
-                    process_line(client_msg);
+                    apply(client_msg);
                 } catch (const std::runtime_error &e) {
                     if (std::string(e.what()) == "QUIT") throw;
                 } catch(...) {}
             }
 
-            // Now read a line from stdin (blocking)
-            if (!isatty(fileno(stdin))) {
-                // if input redirected (script), just read as usual
-                if (!std::getline(std::cin, line)) break;
-                try { process_line(line); } catch(const std::runtime_error &e) { if (std::string(e.what()) == "QUIT") break; }
-            } else {
-                // interactive: show prompt and read; also we can do a short sleep to avoid busy-loop
+            if (interactive && prompt) {
                 std::cout << "> " << std::flush;
-                if (!std::getline(std::cin, line)) break;
-                try { process_line(line); } catch(const std::runtime_error &e) { if (std::string(e.what()) == "QUIT") break; }
+                prompt = false;
             }
+
+            // Wait for stdin at most one poll interval, so expiries and client
+            // messages are still served while no input arrives
+            if (std::cin.rdbuf()->in_avail() <= 0) {
+                pollfd pfd{STDIN_FILENO, POLLIN, 0};
+                if (poll(&pfd, 1, EXPIRY_POLL_MS) <= 0) continue;
+            }
+
+            if (!std::getline(std::cin, line)) break;
+            prompt = true;
+            try { process_line(line); } catch(const std::runtime_error &e) { if (std::string(e.what()) == "QUIT") break; }
         }
     } catch(...) {
         // fallthrough to cleanup
     }
 
     MarketDataServerAPI::stop();
+    Log::stop();
     std::cout << "Exiting.\n";
     return 0;
 }
@@ -1,15 +1,240 @@
 #include "../include/OrderBook.hpp"
+#include "../include/SymbolRegistry.hpp"
 
-int main() {
-    OrderBook book;
+static SymbolRegistry symbols;
 
-    Order o1{1, "AAPL", Side::BUY, OrderType::LIMIT, 100.5, 10, 1};
-    Order o2{2, "AAPL", Side::SELL, OrderType::LIMIT, 101.0, 5, 2};
+template <typename Book>
+static bool runBasic(Book& book) {
+    SymbolId aapl = symbols.intern("AAPL");
+    Order o1{1, aapl, Side::BUY, OrderType::LIMIT, toTicks(100.5, book.tickSize), 10, 1};
+    Order o2{2, aapl, Side::SELL, OrderType::LIMIT, toTicks(101.0, book.tickSize), 5, 2};
 
     book.addOrder(o1);
     book.addOrder(o2);
 
     book.printTopLevels();
 
-    return 0;
+    // Size-down in place, then reprice through the ask
+    std::vector<Trade> trades;
+    book.modifyOrder(1, o1.price, 4, trades);
+    if (book.getDepth(true, 1).at(0).size != 4) return false;
+    book.modifyOrder(1, o2.price, 4, trades);
+    if (trades.size() != 1 || trades[0].quantity != 4 || book.getDepth(false, 1).at(0).size != 1)
+        return false;
+
+    // One lot left on the ask: FOK for two is killed untouched, IOC takes one and drops the rest
+    Order fok{3, aapl, Side::BUY, OrderType::LIMIT, o2.price, 2, 3, TimeInForce::FOK};
+    if (!book.addOrder(fok).empty() || book.lastStatus != OrderStatus::NOT_FILLABLE) return false;
+    Order ioc{4, aapl, Side::BUY, OrderType::LIMIT, o2.price, 2, 4, TimeInForce::IOC};
+    if (book.addOrder(ioc).size() != 1 || !book.empty()) return false;
+
+    // Iceberg shows 3 of 10; once the peak trades it refills behind order 6
+    Order ice{5, aapl, Side::SELL, OrderType::LIMIT, o2.price, 10, 5, TimeInForce::GTC, 3};
+    Order behind{6, aapl, Side::SELL, OrderType::LIMIT, o2.price, 2, 6};
+    book.addOrder(ice);
+    book.addOrder(behind);
+    if (book.getDepth(false, 1).at(0).size != 5) return false;
+    Order sweep{7, aapl, Side::BUY, OrderType::LIMIT, o2.price, 5, 7};
+    trades = book.addOrder(sweep);
+    if (trades.size() != 2 || trades[0].sellOrderId != 5 || trades[1].sellOrderId != 6 ||
+        book.getDepth(false, 1).at(0).size != 3)
+        return false;
+
+    // Mass cancel only takes owner 9's bids and stops; then everything else goes
+    Order mine{8, aapl, Side::BUY, OrderType::LIMIT, o1.price, 1, 8};
+    mine.ownerId = 9;
+    Order theirs{9, aapl, Side::BUY, OrderType::LIMIT, o1.price, 2, 9};
+    Order myStop{20, aapl, Side::BUY, OrderType::STOP, 0, 1, 20};
+    myStop.stopPrice = o2.price * 2;
+    myStop.ownerId = 9;
+    Order theirStop = myStop;
+    theirStop.orderId = 21;
+    theirStop.ownerId = 3;
+    book.addOrder(mine);
+    book.addOrder(theirs);
+    book.addOrder(myStop);
+    book.addOrder(theirStop);
+    if (book.cancelAll(9, SideFilter::BOTH) != 2 || book.getDepth(true, 1).at(0).size != 2 ||
+        book.findStop(20) || !book.findStop(21))
+        return false;
+    if (book.cancelAll(0, SideFilter::BOTH) != 3 || !book.empty()) return false;
+
+    // A GTD order leaves the book when its timer fires; a GTC one stays
+    ExpiryWheel wheel(0, 16);
+    book.expiries = &wheel;
+    Order gtd{10, aapl, Side::BUY, OrderType::LIMIT, o1.price, 1, 10, TimeInForce::GTD};
+    gtd.expireTime = 5 * EXPIRY_TICK_NS;
+    Order gtc{11, aapl, Side::BUY, OrderType::LIMIT, o1.price, 2, 11};
+    book.addOrder(gtd);
+    book.addOrder(gtc);
+    wheel.advance(5, [&](const OrderExpiry& e) { book.expireOrder(e.orderId); });
+    bool expired = wheel.empty() && book.getDepth(true, 1).at(0).size == 2;
+    book.expiries = nullptr;
+    if (!expired) return false;
+
+    // Owner 9 sells into its own bid: cancel-oldest drops the bid instead of trading
+    gtc.ownerId = 9;
+    book.cancelOrder(11);
+    book.addOrder(gtc);
+    Order self{12, aapl, Side::SELL, OrderType::LIMIT, o1.price, 2, 12};
+    self.ownerId = 9;
+    self.stp = SelfTradePrevention::CANCEL_OLDEST;
+    if (!book.addOrder(self).empty() || !book.getDepth(true, 1).empty()) return false;
+    book.cancelOrder(12);
+    if (!book.getDepth(false, 1).empty()) return false;
+
+    // Auction: crossed orders wait, then all trade at one price that fills 3
+    book.startAuction();
+    Order bid{13, aapl, Side::BUY, OrderType::LIMIT, o2.price, 3, 13};
+    Order ask{14, aapl, Side::SELL, OrderType::LIMIT, o1.price, 4, 14};
+    if (!book.addOrder(bid).empty() || !book.addOrder(ask).empty()) return false;
+    trades.clear();
+    std::optional<Price> uncrossPrice = book.uncross(15, trades);
+    bool auctioned = trades.size() == 1 && trades[0].quantity == 3 && trades[0].price == uncrossPrice &&
+                     book.getDepth(true, 1).empty() && book.getDepth(false, 1).at(0).size == 1;
+    book.cancelOrder(14);
+    if (!auctioned) return false;
+
+    // Owner 5's later bid cancels its own older ask instead of trading with it
+    book.startAuction();
+    Order ownAsk{16, aapl, Side::SELL, OrderType::LIMIT, o1.price, 2, 16};
+    ownAsk.ownerId = 5;
+    Order otherAsk{17, aapl, Side::SELL, OrderType::LIMIT, o1.price, 3, 17};
+    Order ownBid{18, aapl, Side::BUY, OrderType::LIMIT, o2.price, 4, 18};
+    ownBid.ownerId = 5;
+    ownBid.stp = SelfTradePrevention::CANCEL_OLDEST;
+    book.addOrder(ownAsk);
+    book.addOrder(otherAsk);
+    book.addOrder(ownBid);
+    trades.clear();
+    uncrossPrice = book.uncross(19, trades);
+    bool prevented = trades.size() == 1 && trades[0].sellOrderId == 17 && trades[0].price == uncrossPrice &&
+                     book.getDepth(false, 1).empty() && book.getDepth(true, 1).at(0).size == 1;
+    book.cancelOrder(18);
+
+    // Nothing crossed, nothing traded: no price
+    book.startAuction();
+    return prevented && !book.uncross(20, trades);
+}
+
+// 20 against 10 + 30 resting: pro-rata splits 5 / 15, top-order priority 10 / 10
+static bool runProRata(bool topOrder) {
+    ProRataOrderBook book;
+    book.topOrderPriority = topOrder;
+    SymbolId aapl = symbols.intern("AAPL");
+    book.addOrder(Order{1, aapl, Side::SELL, OrderType::LIMIT, 100, 10, 1});
+    book.addOrder(Order{2, aapl, Side::SELL, OrderType::LIMIT, 100, 30, 2});
+    auto trades = book.addOrder(Order{3, aapl, Side::BUY, OrderType::LIMIT, 100, 20, 3});
+    uint32_t first = topOrder ? 10 : 5;
+    return trades.size() == 2 && trades[0].quantity == first && trades[1].quantity == 20 - first &&
+           book.getDepth(false, 1).at(0).size == 20;
+}
+
+// A shared id index follows rests, stops, fills and cancels
+static bool runIndex() {
+    OrderIndex index(16);
+    OrderBook book;
+    book.index = &index;
+    SymbolId aapl = symbols.intern("AAPL");
+    book.addOrder(Order{1, aapl, Side::SELL, OrderType::LIMIT, 100, 5, 1});
+    Order stop{2, aapl, Side::BUY, OrderType::STOP, 0, 1, 2};
+    stop.stopPrice = 200;
+    book.addOrder(stop);
+    bool tracked = index.size() == 2 && index.find(1)->node && !index.find(2)->node;
+    book.addOrder(Order{3, aapl, Side::BUY, OrderType::LIMIT, 100, 5, 3});
+    book.cancelOrder(2);
+    return tracked && index.size() == 0;
+}
+
+// Tracked top and change bits follow adds, fills and cancels
+static bool runChanges() {
+    LadderOrderBook book;
+    SymbolId aapl = symbols.intern("AAPL");
+    book.addOrder(Order{1, aapl, Side::BUY, OrderType::LIMIT, 99, 5, 1});
+    book.addOrder(Order{2, aapl, Side::SELL, OrderType::LIMIT, 101, 5, 2});
+    bool opened = book.takeChanges() == (BBO_CHANGED | DEPTH_CHANGED) &&
+                  book.top.bestBid == 99 && book.top.bestAsk == 101;
+
+    // Behind the best: depth only
+    book.addOrder(Order{3, aapl, Side::SELL, OrderType::LIMIT, 102, 5, 3});
+    bool depthOnly = book.takeChanges() == ASK_DEPTH_CHANGED;
+
+    // Best ask swept: the next level becomes the top
+    book.addOrder(Order{4, aapl, Side::BUY, OrderType::MARKET, 0, 5, 4});
+    bool swept = book.takeChanges() == (BBO_CHANGED | ASK_DEPTH_CHANGED) && book.top.bestAsk == 102;
+
+    // A better bid added and cancelled within one call is no BBO change
+    book.addOrder(Order{5, aapl, Side::BUY, OrderType::LIMIT, 100, 5, 5});
+    book.cancelOrder(5);
+    bool netZero = book.takeChanges() == BID_DEPTH_CHANGED;
+
+    book.cancelOrder(1);
+    return opened && depthOnly && swept && netZero &&
+           book.takeChanges() == (BBO_CHANGED | BID_DEPTH_CHANGED) && !book.top.hasBid;
+}
+
+// A peak at or above the order size is no iceberg: a size-up shows in full
+static bool runPeakAtSize() {
+    OrderBook book;
+    SymbolId aapl = symbols.intern("AAPL");
+    book.addOrder(Order{1, aapl, Side::SELL, OrderType::LIMIT, 100, 5, 1, TimeInForce::GTC, 5});
+    book.modifyOrder(1, 100, 8, [](const Trade&) {});
+    if (book.getDepth(false, 1).at(0).size != 8) return false;
+    auto trades = book.addOrder(Order{2, aapl, Side::BUY, OrderType::LIMIT, 100, 8, 2});
+    return trades.size() == 1 && trades[0].quantity == 8 && book.empty();
+}
+
+// FOK with STP: the owner's own asks are no liquidity, and only
+// cancel-oldest may match past them; a resting remainder keeps SELF_TRADE
+static bool runFokSelfTrade() {
+    OrderBook book;
+    SymbolId aapl = symbols.intern("AAPL");
+    auto ask = [&](uint64_t id, Price price, uint32_t qty, uint32_t owner) {
+        Order o{id, aapl, Side::SELL, OrderType::LIMIT, price, qty, id};
+        o.ownerId = owner;
+        book.addOrder(o);
+    };
+    ask(1, 100, 3, 1);
+    ask(2, 100, 5, 7);
+    ask(3, 101, 5, 1);
+
+    Order fok{4, aapl, Side::BUY, OrderType::LIMIT, 101, 8, 4, TimeInForce::FOK};
+    fok.ownerId = 7;
+    fok.stp = SelfTradePrevention::CANCEL_NEWEST;
+    if (!book.addOrder(fok).empty() || book.lastStatus != OrderStatus::NOT_FILLABLE) return false;
+
+    fok.orderId = 5;
+    fok.stp = SelfTradePrevention::CANCEL_OLDEST;
+    auto trades = book.addOrder(fok);
+    if (trades.size() != 2 || trades[0].quantity + trades[1].quantity != 8 || !book.empty()) return false;
+
+    ask(6, 100, 5, 7);
+    Order gtc{7, aapl, Side::BUY, OrderType::LIMIT, 100, 10, 7};
+    gtc.ownerId = 7;
+    gtc.stp = SelfTradePrevention::DECREMENT;
+    book.addOrder(gtc);
+    return book.lastStatus == OrderStatus::SELF_TRADE && book.getDepth(true, 1).at(0).size == 5;
+}
+
+// Off-grid prices are caught before rounding; decimals come back clean
+static bool runTicks() {
+    return isOnTick(100.07, 0.01) && !isOnTick(100.006, 0.01) && isOnTick(100.1, 0.1) &&
+           fromTicks(1001, 0.1) == 100.1 && fromTicks(10007, 0.01) == 100.07;
+}
+
+int main() {
+    OrderBook book;
+    bool ok = runBasic(book);
+
+    LadderOrderBook ladder;
+    ok = runBasic(ladder) && ok;
+
+    ok = runProRata(false) && runProRata(true) && ok;
+    ok = runIndex() && ok;
+    ok = runChanges() && ok;
+    ok = runPeakAtSize() && ok;
+    ok = runTicks() && ok;
+    ok = runFokSelfTrade() && ok;
+
+    return ok && symbols.size() == 1 && symbols.find("MSFT") == INVALID_SYMBOL ? 0 : 1;
 }
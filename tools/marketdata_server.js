@@ -25,6 +25,12 @@ engine.stderr.on("data", (chunk) => {
   // engine.stderr may batch multiple lines — split on newline
   const lines = chunk.toString().split("\n").filter(Boolean);
   for (const line of lines) {
+    // Market data is one JSON object per line; anything else is an engine
+    // diagnostic and stays in the local log
+    if (!line.startsWith("{")) {
+      console.log("[engine-stderr]", line);
+      continue;
+    }
     // broadcast to all connected clients
     wss.clients.forEach((client) => {
       if (client.readyState === WebSocket.OPEN) client.send(line);